@@ -0,0 +1,91 @@
+#include <benchmark/benchmark.h>
+
+#include "../include/benchmarks/sched_counters.h"
+#include "../include/parallel_for.h"
+#include <cstdlib>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Loop body mixing cpu work with blocking reads of a local file, with and
+// without BlockingRegion around the read.
+
+static constexpr size_t TASKS = 1 << 10;
+static constexpr size_t SPIN = 1 << 12;
+static constexpr size_t READ_SIZE = 1 << 16;
+static constexpr size_t FILE_SIZE = 1 << 26;
+
+namespace {
+class TempFile {
+public:
+  TempFile() {
+    std::string path = "/tmp/bench_blocking_XXXXXX";
+    Fd_ = mkstemp(path.data());
+    unlink(path.c_str());
+    std::vector<char> block(READ_SIZE, 'x');
+    for (size_t written = 0; written < FILE_SIZE; written += READ_SIZE) {
+      if (write(Fd_, block.data(), block.size()) < 0) {
+        break;
+      }
+    }
+    fsync(Fd_);
+  }
+
+  ~TempFile() { close(Fd_); }
+
+  // drops file from page cache, so reads go to the disk
+  void DropCache() { posix_fadvise(Fd_, 0, 0, POSIX_FADV_DONTNEED); }
+
+  void Read(size_t block) {
+    thread_local std::vector<char> buffer(READ_SIZE);
+    auto offset = (block * READ_SIZE) % FILE_SIZE;
+    benchmark::DoNotOptimize(pread(Fd_, buffer.data(), READ_SIZE, offset));
+  }
+
+private:
+  int Fd_;
+};
+} // namespace
+
+static void DoSetup(const benchmark::State &state) {
+  InitParallel(GetNumThreads());
+}
+
+static void BM_BlockingReads(benchmark::State &state) {
+  static TempFile file;
+  bool useRegion = state.range(0);
+  size_t readEvery = state.range(1);
+  SchedCounters counters;
+  for (auto _ : state) {
+    state.PauseTiming();
+    file.DropCache();
+    state.ResumeTiming();
+    ParallelFor(0, TASKS, [&](size_t i) {
+      if (i % readEvery == 0) {
+        if (useRegion) {
+          BlockingRegion region;
+          file.Read(i);
+        } else {
+          file.Read(i);
+        }
+      }
+      for (size_t j = 0; j != SPIN; ++j) {
+        CpuRelax();
+      }
+    });
+    benchmark::ClobberMemory();
+  }
+  counters.Export(state);
+}
+
+BENCHMARK(BM_BlockingReads)
+    ->Name("BlockingReads_" + GetParallelMode())
+    ->Setup(DoSetup)
+    ->UseRealTime()
+    ->MeasureProcessCPUTime()
+    ->ArgNames({"region", "read_every"})
+    ->ArgsProduct({{0, 1}, {4, 64}})
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
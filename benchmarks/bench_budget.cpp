@@ -0,0 +1,138 @@
+#include <benchmark/benchmark.h>
+
+#include "../include/benchmarks/sched_counters.h"
+#include "../include/parallel_for.h"
+#include "../include/thread_budget_clients.h"
+#include <condition_variable>
+#include <mutex>
+#include <omp.h>
+#include <thread>
+
+// OpenMP region and EIGEN loop running concurrently in one process, each one
+// sized for the whole machine (oversubscription) or through
+// ThreadBudget::Manager.
+
+static void DoSetup(const benchmark::State &state) {
+  InitParallel(GetNumThreads());
+}
+
+static constexpr size_t TASKS = 1 << 12;
+
+static void Spin(size_t iters) {
+  for (size_t i = 0; i != iters; ++i) {
+    CpuRelax();
+  }
+}
+
+static void RunOmp(size_t spin, ThreadBudget::OmpClient *client) {
+  int threads = client ? client->NumThreads() : GetNumThreads();
+#pragma omp parallel num_threads(threads)
+  {
+    if (client) {
+      client->EnterRegion();
+    }
+#pragma omp for schedule(static)
+    for (size_t i = 0; i < TASKS; ++i) {
+      Spin(spin);
+    }
+  }
+}
+
+namespace {
+// keeps the same thread as omp master, so omp team isn't recreated on each
+// iteration
+class OmpDriver {
+public:
+  OmpDriver() : Thread_([this] { Loop(); }) {}
+
+  ~OmpDriver() {
+    {
+      std::lock_guard<std::mutex> lock(Mutex_);
+      Stop_ = true;
+    }
+    Cv_.notify_all();
+    Thread_.join();
+  }
+
+  void Start(size_t spin, ThreadBudget::OmpClient *client) {
+    {
+      std::lock_guard<std::mutex> lock(Mutex_);
+      Spin_ = spin;
+      Client_ = client;
+      ++Started_;
+    }
+    Cv_.notify_all();
+  }
+
+  void Wait() {
+    std::unique_lock<std::mutex> lock(Mutex_);
+    Cv_.wait(lock, [this] { return Finished_ == Started_; });
+  }
+
+private:
+  void Loop() {
+    std::unique_lock<std::mutex> lock(Mutex_);
+    while (true) {
+      Cv_.wait(lock, [this] { return Stop_ || Finished_ != Started_; });
+      if (Stop_) {
+        return;
+      }
+      lock.unlock();
+      RunOmp(Spin_, Client_);
+      lock.lock();
+      ++Finished_;
+      Cv_.notify_all();
+    }
+  }
+
+  std::mutex Mutex_;
+  std::condition_variable Cv_;
+  size_t Started_ = 0;
+  size_t Finished_ = 0;
+  bool Stop_ = false;
+  size_t Spin_ = 0;
+  ThreadBudget::OmpClient *Client_ = nullptr;
+  std::thread Thread_;
+};
+} // namespace
+
+static void BM_OmpWithEigen(benchmark::State &state) {
+  bool useBudget = state.range(0);
+  size_t spin = state.range(1);
+  auto threadNum = GetNumThreads();
+
+  ThreadBudget::EigenClient eigenClient;
+  ThreadBudget::OmpClient ompClient;
+  auto &manager = ThreadBudget::Manager::Instance();
+  if (useBudget) {
+    manager.Acquire(&eigenClient, threadNum);
+    manager.Acquire(&ompClient, threadNum);
+  }
+
+  OmpDriver omp;
+  SchedCounters counters;
+  for (auto _ : state) {
+    omp.Start(spin, useBudget ? &ompClient : nullptr);
+    ParallelFor(0, TASKS, [spin](size_t) { Spin(spin); });
+    omp.Wait();
+    benchmark::ClobberMemory();
+  }
+  counters.Export(state);
+
+  if (useBudget) {
+    // released clients go back to the setup of InitParallel
+    manager.Release(&ompClient);
+    manager.Release(&eigenClient);
+  }
+}
+
+BENCHMARK(BM_OmpWithEigen)
+    ->Name("OmpWithEigen_" + GetParallelMode())
+    ->Setup(DoSetup)
+    ->UseRealTime()
+    ->MeasureProcessCPUTime()
+    ->ArgNames({"budget", "spin"})
+    ->ArgsProduct({{0, 1}, {1 << 8, 1 << 12}})
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,55 @@
+#include <benchmark/benchmark.h>
+
+#include "../include/benchmarks/sched_counters.h"
+#include "../include/parallel_for.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Many threads outside of the pool calling ParallelFor concurrently, as
+// request threads of a server do (see ConcurrentCalls test).
+
+static constexpr size_t CALLS = 16;
+
+static void DoSetup(const benchmark::State &state) {
+  InitParallel(GetNumThreads());
+}
+
+static void BM_ExternalCalls(benchmark::State &state) {
+  size_t externalThreads = state.range(0);
+  size_t tasks = state.range(1);
+  SchedCounters counters;
+  for (auto _ : state) {
+    std::atomic<size_t> sum(0);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t != externalThreads; ++t) {
+      threads.emplace_back([&] {
+        for (size_t call = 0; call != CALLS; ++call) {
+          ParallelFor(0, tasks, [&](size_t i) {
+            for (size_t j = 0; j != 1 << 8; ++j) {
+              CpuRelax();
+            }
+            sum.fetch_add(1, std::memory_order_relaxed);
+          });
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    benchmark::DoNotOptimize(sum.load());
+  }
+  counters.Export(state);
+  state.SetItemsProcessed(state.iterations() * externalThreads * CALLS);
+}
+
+BENCHMARK(BM_ExternalCalls)
+    ->Name("ExternalCalls_" + GetParallelMode())
+    ->Setup(DoSetup)
+    ->UseRealTime()
+    ->MeasureProcessCPUTime()
+    ->ArgNames({"threads", "tasks"})
+    ->ArgsProduct({{1, 4, 16, 64}, {64, 1024}})
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
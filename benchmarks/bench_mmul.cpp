@@ -1,6 +1,7 @@
 #include "../include/benchmarks/spmv.h"
 #include <benchmark/benchmark.h>
 
+#include "../include/benchmarks/sched_counters.h"
 #include "../include/parallel_for.h"
 
 static const size_t MATRIX_SIZE_HERE = (GetNumThreads() << 3) + (GetNumThreads()) + 7;
@@ -14,10 +15,12 @@ static auto right = SPMV::GenDenseMatrix<double>(MATRIX_SIZE_HERE, MATRIX_SIZE_H
 static auto out = SPMV::DenseMatrix<double>(MATRIX_SIZE_HERE, MATRIX_SIZE_HERE);
 
 static void BM_MatrixMul(benchmark::State &state) {
+  SchedCounters counters;
   // cache data for all iterations
   for (auto _ : state) {
     SPMV::MultiplyMatrix(left, right, out);
   }
+  counters.Export(state);
 }
 
 
@@ -1,6 +1,7 @@
 #include "../include/benchmarks/spmv.h"
 #include <benchmark/benchmark.h>
 
+#include "../include/benchmarks/sched_counters.h"
 #include "../include/parallel_for.h"
 
 static const size_t MATRIX_SIZE = (GetNumThreads() << 4) + GetNumThreads();
@@ -14,10 +15,12 @@ static void BM_MatrixTranspose(benchmark::State &state) {
   static auto out = SPMV::DenseMatrix<double>(MATRIX_SIZE, MATRIX_SIZE);
   benchmark::DoNotOptimize(matrix);
   benchmark::DoNotOptimize(out);
+  SchedCounters counters;
   for (auto _ : state) {
     SPMV::TransposeMatrix(matrix, out);
     benchmark::ClobberMemory();
   }
+  counters.Export(state);
 }
 
 
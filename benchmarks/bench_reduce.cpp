@@ -1,6 +1,7 @@
 #include "../include/benchmarks/spmv.h"
 #include <benchmark/benchmark.h>
 
+#include "../include/benchmarks/sched_counters.h"
 #include "../include/parallel_for.h"
 
 static const size_t MAX_SIZE = (GetNumThreads() << 19) + (GetNumThreads() << 3) + 3;
@@ -11,7 +12,7 @@ static void DoSetup(const benchmark::State &state) {
   InitParallel(GetNumThreads());
 }
 
-void __attribute__((noinline,noipa)) reduceImpl(std::vector<double> &data, size_t blocks, size_t blockSize) {
+void __attribute__((noinline,noipa)) reduceImpl(std::vector<double> &data, size_t blocks, size_t blockSize, size_t grainSize) {
   ParallelFor(0, blocks, [&](size_t i) {
     static thread_local double res = 0;
     benchmark::DoNotOptimize(res);
@@ -22,7 +23,7 @@ void __attribute__((noinline,noipa)) reduceImpl(std::vector<double> &data, size_
       sum += data[j];
     }
     res += sum;
-  });
+  }, grainSize);
 }
 
 static void BM_ReduceBench(benchmark::State &state) {
@@ -30,10 +31,13 @@ static void BM_ReduceBench(benchmark::State &state) {
   benchmark::DoNotOptimize(data);
   auto blockSize = state.range(0) + GetNumThreads() + 3;
   auto blocks = (MAX_SIZE + blockSize - 1) / blockSize;
+  size_t grainSize = state.range(1);
+  SchedCounters counters;
   for (auto _ : state) {
-    reduceImpl(data, blocks, blockSize);
+    reduceImpl(data, blocks, blockSize, grainSize);
     benchmark::ClobberMemory();
   }
+  counters.Export(state);
 }
 
 
@@ -42,9 +46,8 @@ BENCHMARK(BM_ReduceBench)
     ->Setup(DoSetup)
     ->UseRealTime()
     ->MeasureProcessCPUTime()
-    ->ArgName("blocksize")
-    ->RangeMultiplier(2)
-    ->Range(1 << 12, 1 << 19)
+    ->ArgNames({"blocksize", "grainsize"})
+    ->ArgsProduct({benchmark::CreateRange(1 << 12, 1 << 19, 2), {1, 4, 16}})
     ->Unit(benchmark::kMicrosecond);
 
 
@@ -53,9 +56,8 @@ BENCHMARK(BM_ReduceBench)
     ->Setup(DoSetup)
     ->UseRealTime()
     ->MeasureProcessCPUTime()
-    ->ArgName("blocksize")
-    ->RangeMultiplier(2)
-    ->Range(1 << 12, 1 << 19)
+    ->ArgNames({"blocksize", "grainsize"})
+    ->ArgsProduct({benchmark::CreateRange(1 << 12, 1 << 19, 2), {1, 4, 16}})
     ->Unit(benchmark::kMicrosecond)
     ->MinTime(9);
 
@@ -2,6 +2,7 @@
 #include "../include/benchmarks/spmv.h"
 #include <benchmark/benchmark.h>
 
+#include "../include/benchmarks/sched_counters.h"
 #include "../include/parallel_for.h"
 
 static constexpr size_t SIZE_POW = 24;
@@ -13,10 +14,12 @@ static void DoSetup(const benchmark::State &state) {
 static void BM_ScanBench(benchmark::State &state) {
   static auto data = SPMV::GenVector<double>(1 << SIZE_POW);
   benchmark::DoNotOptimize(data);
+  SchedCounters counters;
   for (auto _ : state) {
     Scan::Scan(state.range(0), data);
     benchmark::ClobberMemory();
   }
+  counters.Export(state);
 }
 
 
@@ -1,5 +1,6 @@
 #include <benchmark/benchmark.h>
 
+#include "../include/benchmarks/sched_counters.h"
 #include "../include/parallel_for.h"
 #include "../include/trace.h"
 #include "../include/benchmarks/spmv.h"
@@ -47,6 +48,7 @@ void __attribute__((noinline,noipa)) RunParallelFor(Tracing::Tracer &tracer, siz
 static void BM_Spin(benchmark::State &state) {
   Tracing::Tracer tracer;
   benchmark::DoNotOptimize(tracer);
+  SchedCounters counters;
 #if SPIN_PAYLOAD == RELAX
   for (auto _ : state) {
     RunParallelFor(tracer, state.range(2), state.range(0),
@@ -100,6 +102,7 @@ static void BM_Spin(benchmark::State &state) {
 #else
   static_assert(false, "Unsupported mode");
 #endif
+  counters.Export(state);
   // std::ofstream out(std::string("Spin_") + GetSpinPayload() + "_" +
   //                   GetParallelMode() + ".json");
   // out << tracer.ToJson(GetNumThreads());
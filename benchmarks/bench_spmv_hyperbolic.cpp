@@ -1,6 +1,7 @@
 #include <benchmark/benchmark.h>
 
 #include "../include/benchmarks/spmv.h"
+#include "../include/benchmarks/sched_counters.h"
 #include "../include/parallel_for.h"
 #include <unordered_map>
 
@@ -13,6 +14,9 @@ static void DoSetup(const benchmark::State &state) {
 static constexpr auto width =
     std::array<size_t, 6>{1 << 12, 1 << 13, 1 << 14, 1 << 15, 1 << 16, 1 << 17};
 
+// rows per chunk, passed to ParallelFor as grain size
+static const std::vector<int64_t> grainSizes = {1, 16, 256};
+
 static auto cachedMatrix = [] {
   std::unordered_map<size_t, SparseMatrixCSR<double>> res;
   for (auto &&w : width) {
@@ -31,10 +35,13 @@ static void BM_SpmvBenchHyperbolic(benchmark::State &state) {
   benchmark::DoNotOptimize(y);
 
   auto &A = cachedMatrix.at(state.range(0));
+  size_t grainSize = state.range(1);
+  SchedCounters counters;
   for (auto _ : state) {
-    MultiplyMatrix(A, x, y);
+    MultiplyMatrix(A, x, y, grainSize);
     benchmark::ClobberMemory();
   }
+  counters.Export(state);
 }
 
 
@@ -43,9 +50,8 @@ BENCHMARK(BM_SpmvBenchHyperbolic)
     ->Setup(DoSetup)
     ->UseRealTime()
     ->MeasureProcessCPUTime()
-    ->ArgName("width")
-    ->RangeMultiplier(2)
-    ->Range(*width.begin(), *std::prev(width.end()))
+    ->ArgNames({"width", "grainsize"})
+    ->ArgsProduct({{width.begin(), width.end()}, grainSizes})
     ->Unit(benchmark::kMicrosecond);
 
 BENCHMARK(BM_SpmvBenchHyperbolic)
@@ -53,9 +59,8 @@ BENCHMARK(BM_SpmvBenchHyperbolic)
     ->Setup(DoSetup)
     ->UseRealTime()
     ->MeasureProcessCPUTime()
-    ->ArgName("width")
-    ->RangeMultiplier(2)
-    ->Range(*width.begin(), *std::prev(width.end()))
+    ->ArgNames({"width", "grainsize"})
+    ->ArgsProduct({{width.begin(), width.end()}, grainSizes})
     ->Unit(benchmark::kMicrosecond)
     ->MinTime(9);
 
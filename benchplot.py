@@ -25,19 +25,25 @@ OMP_MODES = [
     "OMP_DYNAMIC_NONMONOTONIC",
     "OMP_DYNAMIC_MONOTONIC",
     "OMP_GUIDED_MONOTONIC",
-    "OMP_GUIDED_NONMONOTONIC"
+    "OMP_GUIDED_NONMONOTONIC",
+    "OMP_TASKLOOP"
 ]
 TBB_MODES = [
     "TBB_AUTO",
     "TBB_SIMPLE",
     "TBB_AFFINITY",
+    "TBB_TIMESPAN",
     # "TBB_CONST_AFFINITY"
 ]
 EIGEN_MODES = [
     "EIGEN_SIMPLE",
     "EIGEN_STATIC",
     "EIGEN_TIMESPAN",
-    "EIGEN_TIMESPAN_GRAINSIZE"
+    "EIGEN_TIMESPAN_GRAINSIZE",
+    "EIGEN_GUIDED",
+    "EIGEN_FACTORING",
+    "EIGEN_AWF",
+    "EIGEN_HEARTBEAT"
 ]
 
 COLORS = "ybgrcmk"
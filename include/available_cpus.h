@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <sched.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// CPUs the process is allowed to run on, in ascending order.
+// Captured once, before any thread pins itself, so later calls don't see a
+// mask narrowed by PinThread.
+inline const std::vector<int> &GetAllowedCpus() {
+  static const std::vector<int> cpus = [] {
+    std::vector<int> res;
+    cpu_set_t mask;
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+      for (int i = 0; i < CPU_SETSIZE; ++i) {
+        if (CPU_ISSET(i, &mask)) {
+          res.push_back(i);
+        }
+      }
+    }
+    if (res.empty()) {
+      for (int i = 0; i < static_cast<int>(std::thread::hardware_concurrency());
+           ++i) {
+        res.push_back(i);
+      }
+    }
+    return res;
+  }();
+  return cpus;
+}
+
+// CPU limit imposed by cgroup bandwidth control (ceil(quota / period)),
+// 0 if there is no limit.
+inline int GetCgroupCpuLimit() {
+  auto limit = [](long long quota, long long period) -> int {
+    if (quota <= 0 || period <= 0) {
+      return 0;
+    }
+    return static_cast<int>((quota + period - 1) / period);
+  };
+  // cgroup v2: "<quota> <period>" or "max <period>"
+  if (std::ifstream cpuMax("/sys/fs/cgroup/cpu.max"); cpuMax) {
+    std::string quota;
+    long long period = 0;
+    if (cpuMax >> quota >> period && quota != "max") {
+      return limit(std::stoll(quota), period);
+    }
+    return 0;
+  }
+  // cgroup v1
+  for (const char *dir : {"/sys/fs/cgroup/cpu,cpuacct", "/sys/fs/cgroup/cpu"}) {
+    std::ifstream quotaFile(std::string(dir) + "/cpu.cfs_quota_us");
+    std::ifstream periodFile(std::string(dir) + "/cpu.cfs_period_us");
+    long long quota = 0, period = 0;
+    if (quotaFile >> quota && periodFile >> period) {
+      return limit(quota, period);
+    }
+  }
+  return 0;
+}
+
+// Number of threads the process can actually run in parallel: the affinity
+// mask intersected with the cgroup quota.
+inline int GetAvailableConcurrency() {
+  int res = static_cast<int>(GetAllowedCpus().size());
+  if (int quota = GetCgroupCpuLimit(); quota > 0) {
+    res = std::min(res, quota);
+  }
+  return std::max(res, 1);
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+// Hardware and OS counters of the whole process around a benchmark loop,
+// from perf_event_open, exported as user counters per iteration. Enabled by
+// BENCH_PERF_COUNTERS env variable. Where PMU isn't available (VMs, high
+// perf_event_paranoid) only software events are counted.
+//
+// Counters are opened for every thread existing at construction (pool
+// workers are started before benchmarks) and inherited by threads they
+// create later.
+class PerfCounters {
+public:
+  PerfCounters() {
+    if (!std::getenv("BENCH_PERF_COUNTERS")) {
+      return;
+    }
+    auto threads = Threads();
+    bool hardware = !threads.empty() && CanOpen(threads.front(), CYCLES);
+    for (size_t event = 0; event != EVENTS; ++event) {
+      if (!hardware && EVENT_INFOS[event].Hardware) {
+        continue;
+      }
+      for (auto tid : threads) {
+        auto fd = Open(tid, static_cast<Event>(event));
+        if (fd >= 0) {
+          Fds_[event].push_back(fd);
+        }
+      }
+    }
+    static bool warned = false;
+    if (!hardware && !warned) {
+      warned = true;
+      std::cerr << "perf_event_open: hardware events aren't available, "
+                << "only software ones are counted\n";
+    }
+    for (auto &fds : Fds_) {
+      for (auto fd : fds) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+  }
+
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  ~PerfCounters() {
+    for (auto &fds : Fds_) {
+      for (auto fd : fds) {
+        close(fd);
+      }
+    }
+  }
+
+  void Export(benchmark::State &state) {
+    for (size_t event = 0; event != EVENTS; ++event) {
+      if (Fds_[event].empty()) {
+        continue;
+      }
+      double total = 0;
+      for (auto fd : Fds_[event]) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        total += Read(fd);
+      }
+      state.counters[EVENT_INFOS[event].Name] =
+          benchmark::Counter(total, benchmark::Counter::kAvgIterations);
+      Totals_[event] = total;
+    }
+    if (Totals_[CYCLES] != 0) {
+      state.counters["ipc"] = Totals_[INSTRUCTIONS] / Totals_[CYCLES];
+    }
+  }
+
+private:
+  enum Event {
+    CYCLES,
+    INSTRUCTIONS,
+    LLC_MISSES,
+    CONTEXT_SWITCHES,
+    CPU_MIGRATIONS,
+    TASK_CLOCK,
+    EVENTS
+  };
+
+  struct EventInfo {
+    const char *Name;
+    uint32_t Type;
+    uint64_t Config;
+    bool Hardware;
+  };
+
+  static constexpr EventInfo EVENT_INFOS[EVENTS] = {
+      {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, true},
+      {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, true},
+      {"llc_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, true},
+      {"context_switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES,
+       false},
+      {"cpu_migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS,
+       false},
+      {"task_clock_ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, false},
+  };
+
+  static std::vector<pid_t> Threads() {
+    std::vector<pid_t> threads;
+    if (DIR *dir = opendir("/proc/self/task")) {
+      while (auto *entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+          threads.push_back(std::atoi(entry->d_name));
+        }
+      }
+      closedir(dir);
+    }
+    return threads;
+  }
+
+  static int Open(pid_t tid, Event event) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = EVENT_INFOS[event].Type;
+    attr.config = EVENT_INFOS[event].Config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_hv = 1;
+    // counters may be multiplexed, Read scales them
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    int fd = syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0);
+    if (fd < 0) {
+      // with perf_event_paranoid >= 2 only user space may be counted
+      attr.exclude_kernel = 1;
+      fd = syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0);
+    }
+    return fd;
+  }
+
+  static bool CanOpen(pid_t tid, Event event) {
+    auto fd = Open(tid, event);
+    if (fd < 0) {
+      return false;
+    }
+    close(fd);
+    return true;
+  }
+
+  static double Read(int fd) {
+    struct {
+      uint64_t Value;
+      uint64_t Enabled;
+      uint64_t Running;
+    } data;
+    if (read(fd, &data, sizeof(data)) != sizeof(data) || data.Running == 0) {
+      return 0;
+    }
+    return static_cast<double>(data.Value) * data.Enabled / data.Running;
+  }
+
+  std::vector<int> Fds_[EVENTS];
+  double Totals_[EVENTS] = {};
+};
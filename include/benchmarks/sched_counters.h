@@ -0,0 +1,44 @@
+#pragma once
+
+#include "../parallel_for.h"
+#include "perf_counters.h"
+#include <benchmark/benchmark.h>
+
+// Exports EigenPool scheduler counters collected during the benchmark loop
+// as user counters: events per iteration and idle fraction (share of worker
+// loop iterations which found no task). Does nothing unless built with
+// EIGEN_POOL_STATS in one of EIGEN modes. Also exports PerfCounters.
+class SchedCounters {
+public:
+  SchedCounters() {
+#ifdef EIGEN_MODE
+    EigenPool.ResetStats();
+#endif
+  }
+
+  void Export(benchmark::State &state) {
+    Perf_.Export(state);
+#if defined(EIGEN_MODE) && defined(EIGEN_POOL_STATS)
+    Eigen::ThreadPool::ThreadStats total;
+    for (auto &stats : EigenPool.GetStats()) {
+      total += stats;
+    }
+    auto perIteration = [](uint64_t value) {
+      return benchmark::Counter(value, benchmark::Counter::kAvgIterations);
+    };
+    state.counters["runnext_pops"] = perIteration(total.runnext_pops);
+    state.counters["local_pops"] = perIteration(total.local_pops);
+    state.counters["injected_pops"] = perIteration(total.injected_pops);
+    state.counters["steal_attempts"] = perIteration(total.steal_attempts);
+    state.counters["steals"] = perIteration(total.steals);
+    state.counters["inline_executions"] =
+        perIteration(total.inline_executions);
+    auto loops = total.idle_loops + total.Tasks();
+    state.counters["idle_fraction"] =
+        loops ? static_cast<double>(total.idle_loops) / loops : 0;
+#endif
+  }
+
+private:
+  PerfCounters Perf_;
+};
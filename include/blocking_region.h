@@ -0,0 +1,30 @@
+#pragma once
+#include "eigen_pool.h"
+#include "modes.h"
+
+// Marks a call inside a parallel loop body which may block (read, fsync,
+// waiting on a mutex...). In EIGEN modes tasks queued to the blocked worker
+// (including runnext) become stealable and a spare thread keeps executing
+// them until the region is left. No-op for other runtimes.
+class BlockingRegion {
+public:
+  BlockingRegion() {
+#ifdef EIGEN_MODE
+    Entered_ = EigenPool.EnterBlocking();
+#endif
+  }
+
+  ~BlockingRegion() {
+#ifdef EIGEN_MODE
+    if (Entered_) {
+      EigenPool.LeaveBlocking();
+    }
+#endif
+  }
+
+  BlockingRegion(const BlockingRegion &) = delete;
+  BlockingRegion &operator=(const BlockingRegion &) = delete;
+
+private:
+  [[maybe_unused]] bool Entered_ = false;
+};
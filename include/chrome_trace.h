@@ -0,0 +1,183 @@
+#pragma once
+#include "clock.h"
+#include "ring_trace.h"
+#include "trace.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Exporter to Chrome Trace Event JSON, which is opened by chrome://tracing,
+// Perfetto UI and speedscope. Every thread is a track, every task is a slice.
+namespace Tracing {
+
+// Streams events to out as they are added, nothing is kept in memory.
+// Timestamps are Now() ticks, they are written relative to origin.
+class ChromeTraceWriter {
+public:
+  ChromeTraceWriter(std::ostream &out, Timestamp origin,
+                    double ticksPerNs = TicksPerNs())
+      : Out_(out), Origin_(origin), TicksPerNs_(ticksPerNs) {
+    // "ts" and "dur" are in microseconds, with three digits after the point
+    // they keep nanoseconds
+    Out_ << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+    Out_.setf(std::ios::fixed);
+    Out_.precision(3);
+  }
+
+  ~ChromeTraceWriter() { Out_ << "\n]}\n"; }
+
+  void ThreadName(int tid, const std::string &name) {
+    Next();
+    Out_ << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+         << "\"tid\": " << tid << ", \"args\": {\"name\": \"" << name
+         << "\"}}";
+  }
+
+  // complete event "<name> <index>", cpu is omitted if it's negative
+  void Slice(int tid, const char *name, size_t index, Timestamp start,
+             Timestamp end, int cpu = -1) {
+    Next();
+    auto ts = ToUs(start);
+    Out_ << "{\"name\": \"" << name << " " << index
+         << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << tid
+         << ", \"ts\": " << ts << ", \"dur\": " << ToUs(end) - ts;
+    if (cpu >= 0) {
+      Out_ << ", \"args\": {\"cpu\": " << cpu << "}";
+    }
+    Out_ << "}";
+  }
+
+  // instant event "<name>" with its argument
+  void Instant(int tid, const char *name, Timestamp time, uint32_t arg) {
+    Next();
+    Out_ << "{\"name\": \"" << name
+         << "\", \"ph\": \"i\", \"s\": \"t\", \"pid\": 1, \"tid\": "
+         << tid << ", \"ts\": " << ToUs(time) << ", \"args\": {\"arg\": "
+         << arg << "}}";
+  }
+
+private:
+  void Next() {
+    Out_ << (First_ ? "\n" : ",\n");
+    First_ = false;
+  }
+
+  double ToUs(Timestamp time) const {
+    return time < Origin_ ? 0 : (time - Origin_) / TicksPerNs_ / 1000;
+  }
+
+  std::ostream &Out_;
+  const Timestamp Origin_;
+  const double TicksPerNs_;
+  bool First_ = true;
+};
+
+// Tracks are threads of ThreadIdx, iterations are slices on the thread
+// which started them (tid -1 if it isn't known).
+inline void WriteChromeTrace(const std::vector<IterationResult> &results,
+                             std::ostream &out) {
+  Timestamp origin = results.empty() ? 0 : results.front().Start;
+  ChromeTraceWriter writer(out, origin);
+  std::vector<int> named;
+  for (size_t iter = 0; iter != results.size(); ++iter) {
+    auto &result = results[iter];
+    writer.Slice(-1, "iteration", iter, result.Start,
+                 result.Start + result.End);
+    for (auto &task : result.Tasks) {
+      if (std::find(named.begin(), named.end(), task.ThreadIdx) ==
+          named.end()) {
+        named.push_back(task.ThreadIdx);
+        writer.ThreadName(task.ThreadIdx,
+                          "thread " + std::to_string(task.ThreadIdx));
+      }
+      writer.Slice(task.ThreadIdx, "task", task.TaskIdx,
+                   result.Start + task.Trace.ExecutionStart,
+                   result.Start + task.Trace.ExecutionEnd, task.SchedCpu);
+    }
+  }
+}
+
+// name of a scheduler trace point
+inline const char *EventName(EventKind kind) {
+  switch (kind) {
+  case EventKind::SPAWN:
+    return "spawn";
+  case EventKind::SPLIT:
+    return "split";
+  case EventKind::INIT_END:
+    return "init_end";
+  case EventKind::PUSH:
+    return "push";
+  case EventKind::STEAL:
+    return "steal";
+  case EventKind::STEAL_FAILED:
+    return "steal_failed";
+  default:
+    return "unknown";
+  }
+}
+
+// Straight from the buffers, so dropped records only lose their slices.
+// A track is a buffer, as one pool index may be used by several threads.
+// Scheduler trace points are instants, idle periods are slices.
+inline void WriteChromeTrace(const RingTracer &tracer, std::ostream &out) {
+  Timestamp origin = std::numeric_limits<Timestamp>::max();
+  tracer.ForEachBuffer([&](size_t, const RingBuffer &buffer) {
+    buffer.ForEach([&](const Record &record) {
+      origin = std::min(origin, record.Time);
+    });
+  });
+  ChromeTraceWriter writer(out, origin);
+  tracer.ForEachBuffer([&](size_t tid, const RingBuffer &buffer) {
+    writer.ThreadName(tid, "thread " + std::to_string(buffer.Thread));
+    std::vector<Record> started; // tasks, iterations and idle periods
+    size_t iteration = 0;
+    size_t idle = 0;
+    buffer.ForEach([&](const Record &record) {
+      switch (record.Kind) {
+      case EventKind::ITERATION_START:
+      case EventKind::TASK_START:
+      case EventKind::IDLE_START:
+        started.push_back(record);
+        return;
+      case EventKind::ITERATION_END:
+      case EventKind::TASK_END:
+      case EventKind::IDLE_END:
+        break;
+      default:
+        writer.Instant(tid, EventName(record.Kind), record.Time, record.Arg);
+        return;
+      }
+      if (started.empty()) {
+        return; // start was overwritten
+      }
+      auto start = started.back();
+      started.pop_back();
+      if (start.Kind == EventKind::ITERATION_START) {
+        writer.Slice(tid, "iteration", iteration++, start.Time, record.Time);
+      } else if (start.Kind == EventKind::IDLE_START) {
+        writer.Slice(tid, "idle", idle++, start.Time, record.Time);
+      } else {
+        writer.Slice(tid, "task", start.Arg, start.Time, record.Time,
+                     start.Cpu == NO_CPU ? buffer.Cpu : start.Cpu);
+      }
+    });
+  });
+}
+
+// Writes trace to the file from TRACE_CHROME_FILE, if it's set.
+template <typename T> void WriteChromeTraceFromEnv(const T &trace) {
+  if (const char *path = std::getenv("TRACE_CHROME_FILE")) {
+    std::ofstream out(path);
+    WriteChromeTrace(trace, out);
+  }
+}
+
+} // namespace Tracing
@@ -0,0 +1,109 @@
+#pragma once
+#include "clock.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Chunk sizes of self-scheduling loops (see self_scheduling_partitioner.h).
+// Only arithmetic, doesn't depend on the runtime.
+namespace EigenPartitioner {
+
+// Work done by one thread during one loop.
+struct alignas(64) ThreadStat {
+  size_t Iterations = 0;
+  Timestamp Cycles = 0;
+};
+
+// Relative speed of pool threads (1 is average) learned over previous loops.
+// Speed is normalized within each loop, so loops with different bodies can
+// be mixed, and blended into the weight with DECAY.
+class ThreadWeights {
+public:
+  static constexpr double DECAY = 0.5; // share of the old weight
+
+  explicit ThreadWeights(size_t threads)
+      : Size_(threads), Weights_(new Weight[threads]) {}
+
+  // average weight for threads outside of the pool
+  double Get(size_t thread) const {
+    return thread < Size_ ? Weights_[thread].Value.load(std::memory_order_relaxed)
+                          : 1.0;
+  }
+
+  void Update(const std::vector<ThreadStat> &stats) {
+    double speedSum = 0;
+    size_t measured = 0;
+    for (auto &stat : stats) {
+      if (stat.Iterations != 0 && stat.Cycles != 0) {
+        speedSum += static_cast<double>(stat.Iterations) / stat.Cycles;
+        ++measured;
+      }
+    }
+    if (measured < 2) {
+      return; // nothing to compare with
+    }
+    auto count = std::min(stats.size(), Size_);
+    for (size_t i = 0; i != count; ++i) {
+      if (stats[i].Iterations == 0 || stats[i].Cycles == 0) {
+        continue;
+      }
+      auto speed = static_cast<double>(stats[i].Iterations) / stats[i].Cycles;
+      auto &weight = Weights_[i].Value;
+      weight.store(DECAY * weight.load(std::memory_order_relaxed) +
+                       (1 - DECAY) * speed * measured / speedSum,
+                   std::memory_order_relaxed);
+    }
+  }
+
+private:
+  struct alignas(64) Weight {
+    std::atomic<double> Value{1.0};
+  };
+
+  const size_t Size_;
+  std::unique_ptr<Weight[]> Weights_;
+};
+
+// Chunk is [first, second) relative to the loop start, first == total when
+// there are no iterations left.
+using Chunk = std::pair<size_t, size_t>;
+
+// k'th chunk of FAC2 schedule, computed from k only, so chunks can be claimed
+// with a single fetch_add. Batch sizes halve, so the loop is O(log(total)).
+inline Chunk FactoringChunk(size_t k, size_t total, size_t threads,
+                            size_t minChunk = 1) {
+  size_t start = 0;
+  size_t batch = k / threads;
+  size_t chunk = 0;
+  for (size_t b = 0; b <= batch; ++b) {
+    size_t remaining = total - start;
+    if (remaining == 0) {
+      return {total, total};
+    }
+    chunk = std::max(minChunk, (remaining + 2 * threads - 1) / (2 * threads));
+    if (b != batch) {
+      start += std::min(remaining, chunk * threads);
+    }
+  }
+  start = std::min(total, start + (k % threads) * chunk);
+  return {start, std::min(total, start + chunk)};
+}
+
+// chunk claimed by guided schedule when `next` iterations are taken already
+inline size_t GuidedChunkSize(size_t next, size_t total, size_t threads,
+                              size_t minChunk = 1) {
+  return std::max(minChunk, (total - next + threads - 1) / threads);
+}
+
+// AWF chunk: thread's weighted share of half of the remaining iterations
+inline size_t WeightedChunkSize(size_t next, size_t total, double weight,
+                                double weightSum, size_t minChunk = 1) {
+  auto size = static_cast<size_t>((total - next) * weight / (2 * weightSum));
+  return std::max(minChunk, size + 1);
+}
+
+} // namespace EigenPartitioner
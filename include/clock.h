@@ -0,0 +1,97 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#if defined(__x86_64__)
+// for rdtsc
+#include "x86intrin.h"
+#include <cpuid.h>
+#endif
+
+using Timestamp = uint64_t;
+// using Timestamp = std::chrono::system_clock::time_point;
+
+inline Timestamp Now() {
+#if defined(__x86_64__)
+  return __rdtsc();
+#elif defined(__aarch64__)
+  // System timer of ARMv8 runs at a different frequency than the CPU's.
+  // The frequency is fixed, typically in the range 1-50MHz.  It can be
+  // read at CNTFRQ special register.  We assume the OS has set up
+  // the virtual timer properly.
+  asm volatile("isb");
+  Timestamp virtual_timer_value;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(virtual_timer_value));
+  return virtual_timer_value;
+#else
+#error "Unsupported architecture"
+#endif
+  // return std::chrono::duration_cast<std::chrono::nanoseconds>(
+  //            std::chrono::high_resolution_clock::now().time_since_epoch())
+  //     .count();
+}
+
+// True if Now() ticks at a constant rate regardless of frequency scaling and
+// sleep states: invariant TSC (CPUID 0x80000007, EDX bit 8) on x86, generic
+// timer always is on aarch64.
+inline bool IsClockInvariant() {
+#if defined(__x86_64__)
+  unsigned eax, ebx, ecx, edx;
+  if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+  return edx & (1u << 8);
+#else
+  return true;
+#endif
+}
+
+// Now() ticks per nanosecond. On aarch64 it's CNTFRQ, on x86 TSC is
+// calibrated against steady_clock once, at the first call (takes ~15ms).
+inline double TicksPerNs() {
+  static const double ticksPerNs = [] {
+#if defined(__aarch64__)
+    uint64_t frequency;
+    asm volatile("mrs %0, cntfrq_el0" : "=r"(frequency));
+    return frequency / 1e9;
+#else
+    if (!IsClockInvariant()) {
+      std::cerr << "TSC is not invariant, Now() intervals aren't time\n";
+    }
+    // median of a few runs, so one preemption doesn't spoil it
+    double rates[3];
+    for (auto &rate : rates) {
+      auto clockStart = std::chrono::steady_clock::now();
+      auto start = Now();
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      auto ticks = Now() - start;
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - clockStart)
+                    .count();
+      rate = static_cast<double>(ticks) / ns;
+    }
+    std::sort(rates, rates + 3);
+    return rates[1];
+#endif
+  }();
+  return ticksPerNs;
+}
+
+inline double CyclesToNs(Timestamp cycles) { return cycles / TicksPerNs(); }
+
+inline Timestamp NsToCycles(double ns) {
+  return static_cast<Timestamp>(ns * TicksPerNs());
+}
+
+// spin-wait hint, lives here so pools included by util.h can use it
+inline void CpuRelax() {
+#if defined(__x86_64__)
+  asm volatile("pause\n" : : : "memory");
+#elif defined(__aarch64__)
+  asm volatile("yield\n" : : : "memory");
+#else
+#error "Unsupported architecture"
+#endif
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace Eigen {
+
+// Bounded lock-free MPMC queue for tasks submitted from outside of the pool
+// (D. Vyukov's bounded MPMC queue). Each cell has a sequence number telling
+// whether it's free for the producer or ready for the consumer of the current
+// lap, so producers and consumers only contend on their own index.
+// Consumers can take several consecutive ready cells with one CAS.
+template <typename Work, unsigned kSize> class InjectionQueue {
+public:
+  InjectionQueue() {
+    static_assert((kSize & (kSize - 1)) == 0, "size must be a power of two");
+    for (unsigned i = 0; i < kSize; i++) {
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // Returns false if the queue is full.
+  bool Push(Work w) {
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    while (true) {
+      Cell &cell = cells_[pos & kMask];
+      size_t seq = cell.seq.load(std::memory_order_acquire);
+      auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          cell.w = std::move(w);
+          cell.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Pops up to n first elements to out, returns the number of popped ones.
+  unsigned PopBatch(Work *out, unsigned n) {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    while (true) {
+      unsigned ready = 0;
+      while (ready < n && cells_[(pos + ready) & kMask].seq.load(
+                              std::memory_order_acquire) == pos + ready + 1) {
+        ++ready;
+      }
+      if (ready == 0) {
+        size_t seq = cells_[pos & kMask].seq.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1) < 0) {
+          return 0; // empty, or first element isn't published yet
+        }
+        pos = head_.load(std::memory_order_relaxed); // taken by other consumer
+        continue;
+      }
+      if (head_.compare_exchange_weak(pos, pos + ready,
+                                      std::memory_order_relaxed)) {
+        for (unsigned i = 0; i != ready; ++i) {
+          Cell &cell = cells_[(pos + i) & kMask];
+          out[i] = std::move(cell.w);
+          cell.seq.store(pos + i + kSize, std::memory_order_release);
+        }
+        return ready;
+      }
+    }
+  }
+
+  // Approximate, can be used as a hint only.
+  size_t Size() const {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    auto head = head_.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+  }
+
+  bool Empty() const { return Size() == 0; }
+
+private:
+  static constexpr unsigned kMask = kSize - 1;
+
+  struct Cell {
+    std::atomic<size_t> seq;
+    Work w;
+  };
+
+  Cell cells_[kSize];
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) std::atomic<size_t> tail_{0};
+};
+
+} // namespace Eigen
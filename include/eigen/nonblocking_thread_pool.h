@@ -13,12 +13,30 @@
 #include <memory>
 #define EIGEN_POOL_RUNNEXT
 
+// EIGEN_POOL_STATS enables per-thread scheduler counters, see GetStats
+#ifdef EIGEN_POOL_STATS
+#define EIGEN_POOL_STAT(counters, name, value)                                 \
+  CountStat(counters, (counters).name, value)
+#else
+#define EIGEN_POOL_STAT(counters, name, value) ((void)0)
+#endif
+
+#include "../trace_buffer.h"
+#include "injection_queue.h"
 #include "max_size_vector.h"
 #include "run_queue.h"
 #include "stl_thread_env.h"
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
 #include <functional>
+#include <mutex>
+#include <pthread.h>
 #include <thread>
+#include <vector>
 
 namespace Eigen {
 
@@ -84,10 +102,17 @@ public:
 
   ThreadPoolTempl(int num_threads, bool allow_spinning, bool use_main_thread,
                   Environment env = Environment())
-      : env_(env), num_threads_(num_threads), allow_spinning_(allow_spinning),
-        thread_data_(num_threads), all_coprimes_(num_threads),
+      : env_(env), pool_index_(AcquirePoolIndex()),
+        generation_(pool_generations_.fetch_add(1, std::memory_order_relaxed) +
+                    1),
+        num_threads_(num_threads),
+        active_threads_(num_threads),
+        allow_spinning_(allow_spinning),
+        thread_data_(num_threads + kExternalSlots),
+        all_coprimes_(std::max(num_threads, kExternalSlots)),
         global_steal_partition_(EncodePartition(0, num_threads_)), blocked_(0),
-        spinning_(0), done_(false), cancelled_(false) {
+        spinning_(0), done_(false), cancelled_(false),
+        main_native_handle_(pthread_self()) {
     // Calculate coprimes of all numbers [1, num_threads].
     // Coprimes are used for random walks over all threads in Steal
     // and NonEmptyQueueIndex. Iteration is based on the fact that if we take
@@ -95,12 +120,21 @@ public:
     // indices as (t + coprime) % num_threads, we will cover all threads without
     // repetitions (effectively getting a presudo-random permutation of thread
     // indices).
-    assert(num_threads_ < kMaxThreads);
-    for (int i = 1; i <= num_threads_; ++i) {
+    assert(num_threads_ + kExternalSlots < kMaxThreads);
+    for (int i = 1; i <= std::max(num_threads_, kExternalSlots); ++i) {
       all_coprimes_.emplace_back(i);
       ComputeCoprimes(i, &all_coprimes_.back());
     }
-    thread_data_.resize(num_threads_);
+    thread_data_.resize(num_threads_ + kExternalSlots);
+#ifdef EIGEN_POOL_STATS
+    // one more for threads outside of the pool
+    for (size_t i = 0; i <= thread_data_.size(); ++i) {
+      counters_.push_back(std::make_unique<Counters>(thread_data_.size()));
+    }
+#endif
+    for (int i = num_threads_; i < num_threads_ + kExternalSlots; i++) {
+      SetStealPartition(i, EncodePartition(0, num_threads_));
+    }
     for (int i = 0; i < num_threads_; i++) {
       SetStealPartition(i, EncodePartition(0, num_threads_));
       if (i == 0) {
@@ -114,7 +148,7 @@ public:
           pt->pool = this;
           pt->rand = GlobalThreadIdHash();
           pt->thread_id = i;
-          WorkerLoop();
+          WorkerLoop(/* external */ false, [] { return false; });
         }));
       }
     }
@@ -122,6 +156,13 @@ public:
 
   ~ThreadPoolTempl() {
     done_ = true;
+    WakeParked();
+    {
+      std::lock_guard<std::mutex> lock(spare_mutex_);
+      for (auto &spare : spares_) {
+        spare->cv.notify_one();
+      }
+    }
 
     // Now if all threads block without work, they will start exiting.
     // But note that threads can continue to work arbitrary long,
@@ -129,6 +170,9 @@ public:
     if (cancelled_) {
       // Since we were cancelled, there might be entries in the queues.
       // Empty them to prevent their destructor from asserting.
+      TaskPtr t;
+      while (injected_.PopBatch(&t, 1)) {
+      }
       for (size_t i = 0; i < thread_data_.size(); i++) {
         thread_data_[i].queue.Flush();
       }
@@ -137,6 +181,17 @@ public:
     // this class.
     for (size_t i = 0; i < thread_data_.size(); ++i)
       thread_data_[i].thread.reset();
+    // workers are gone, so no spare is activated anymore; spares exit on done_
+    // and are joined before their cv is destroyed
+    for (auto &spare : spares_) {
+      spare->thread.reset();
+    }
+    spares_.clear();
+    // PerThread entries of this pool left in other threads (e.g. of the thread
+    // which created it) are reset by the next pool with this index, as their
+    // generation differs
+    used_pool_indices_.fetch_and(~(1u << pool_index_),
+                                 std::memory_order_release);
   }
 
   void SetStealPartitions(
@@ -155,15 +210,16 @@ public:
 
   void Schedule(TaskPtr p) override {
     // schedule on main thread only when explicitly requested
-    ScheduleWithHint(p, 0, num_threads_);
+    ScheduleWithHint(p, 0, NumActiveThreads());
   }
 
   void RunOnThread(TaskPtr t, size_t threadIndex) {
-    threadIndex = threadIndex % num_threads_;
+    threadIndex = threadIndex % NumActiveThreads();
     PerThread *pt = GetPerThread();
     if (!thread_data_[threadIndex].PushTask(
             t, !(pt && threadIndex == pt->thread_id))) {
       // failed to push, execute directly
+      EIGEN_POOL_STAT(CountersOf(pt), inline_executions, 1);
       ExecuteTask(t);
     }
   }
@@ -178,8 +234,13 @@ public:
         return;
       }
     } else {
-      // A free-standing thread (or worker of another pool), push onto a random
-      // queue.
+      // A free-standing thread (or worker of another pool): if any worker may
+      // run the task, put it to the injection queue, so it doesn't contend
+      // with steals and is taken by the first worker running out of work.
+      if (start == 0 && limit >= NumActiveThreads() && injected_.Push(t)) {
+        return;
+      }
+      // Otherwise (or if it's full) push onto a random queue.
       assert(start < limit);
       assert(limit <= num_threads_);
       int num_queues = limit - start;
@@ -197,6 +258,7 @@ public:
     // completes overall computations, which in turn leads to destruction of
     // this. We expect that such scenario is prevented by program, that is,
     // this is kept alive while any threads can potentially be in Schedule.
+    EIGEN_POOL_STAT(CountersOf(pt), inline_executions, 1);
     ExecuteTask(t); // Push failed, execute directly.
   }
 
@@ -214,6 +276,33 @@ public:
 
   int NumThreads() const final { return num_threads_; }
 
+  // Native handle of the i'th worker, 0 is the thread that created the pool.
+  // Can be used to change worker placement from another thread.
+  auto NativeHandle(int i) {
+    if (i == 0) {
+      return main_native_handle_;
+    }
+    return thread_data_[i].thread->NativeHandle();
+  }
+
+  // Number of workers currently taking part in scheduling, [1, NumThreads()].
+  int NumActiveThreads() const {
+    return active_threads_.load(std::memory_order_acquire);
+  }
+
+  // Changes the number of active workers at runtime. Workers with index >= n
+  // finish tasks already pushed to them and park until the pool is grown
+  // back; they are excluded from stealing and from RunOnThread targets.
+  // Thread 0 is always active. Can't grow beyond NumThreads().
+  void SetActiveThreads(int n) {
+    n = std::max(1, std::min(n, num_threads_));
+    {
+      std::lock_guard<std::mutex> lock(park_mutex_);
+      active_threads_.store(n, std::memory_order_release);
+    }
+    park_cv_.notify_all();
+  }
+
   int CurrentThreadId() const final {
     const PerThread *pt = const_cast<ThreadPoolTempl *>(this)->GetPerThread();
     if (pt->pool == this) {
@@ -223,11 +312,193 @@ public:
     }
   }
 
-  void JoinMainThread() {
+  // Called by a worker before a call which may block (read, fsync, mutex...),
+  // see BlockingRegion. Until LeaveBlocking thieves take its runnext as well
+  // and a spare thread, pinned as the worker, executes tasks of its slot.
+  // Returns false for non-workers and nested calls, they shouldn't leave.
+  bool EnterBlocking() {
+    PerThread *pt = GetPerThread();
+    if (pt->pool != this) {
+      return false;
+    }
+    auto &data = thread_data_[pt->thread_id];
+    if (data.blocking.exchange(true, std::memory_order_acq_rel)) {
+      return false;
+    }
+    ActivateSpare(pt->thread_id);
+    return true;
+  }
+
+  // Spare retires after its current task.
+  void LeaveBlocking() {
+    PerThread *pt = GetPerThread();
+    thread_data_[pt->thread_id].blocking.store(false,
+                                               std::memory_order_release);
+  }
+
+  // Lets a thread outside of the pool take one of reserved slots for the
+  // duration of a parallel loop: tasks it schedules go to its own queue, which
+  // workers steal from, and JoinMainThread runs WorkerLoop in it.
+  // Returns false if the thread is a worker already or all slots are taken.
+  bool LeaseExternalSlot() {
+    PerThread *pt = GetPerThread();
+    if (pt->pool == this) {
+      return false;
+    }
+    for (int i = num_threads_; i < num_threads_ + kExternalSlots; ++i) {
+      auto &leased = thread_data_[i].leased;
+      bool expected = false;
+      if (!leased.load(std::memory_order_relaxed) &&
+          leased.compare_exchange_strong(expected, true,
+                                         std::memory_order_acquire)) {
+        pt->pool = this;
+        pt->thread_id = i;
+        pt->rand = GlobalThreadIdHash();
+        leased_slots_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Only the owner pushes to an external slot, so its queue is empty after
+  // JoinMainThread.
+  void ReleaseExternalSlot() {
+    PerThread *pt = GetPerThread();
+    auto &data = thread_data_[pt->thread_id];
+    assert(pt->thread_id >= num_threads_ && data.Empty());
+    data.ResetIdle();
+    *pt = PerThread();
+    leased_slots_.fetch_sub(1, std::memory_order_relaxed);
+    data.leased.store(false, std::memory_order_release);
+  }
+
+  // Scheduler counters of one thread (or of all threads outside of the pool).
+  struct ThreadStats {
+    uint64_t runnext_pops = 0;      // tasks taken from own runnext
+    uint64_t local_pops = 0;        // from own queue
+    uint64_t injected_pops = 0;     // from the injection queue
+    uint64_t steal_attempts = 0;    // victims probed
+    uint64_t steals = 0;            // successful probes
+    uint64_t inline_executions = 0; // push failed, task was run in place
+    uint64_t idle_loops = 0;        // worker loop iterations without a task
+    std::vector<uint64_t> steal_attempts_from; // by victim slot
+    std::vector<uint64_t> steals_from;
+
+    uint64_t Tasks() const {
+      return runnext_pops + local_pops + injected_pops + steals;
+    }
+
+    ThreadStats &operator+=(const ThreadStats &other) {
+      runnext_pops += other.runnext_pops;
+      local_pops += other.local_pops;
+      injected_pops += other.injected_pops;
+      steal_attempts += other.steal_attempts;
+      steals += other.steals;
+      inline_executions += other.inline_executions;
+      idle_loops += other.idle_loops;
+      steal_attempts_from.resize(other.steal_attempts_from.size());
+      steals_from.resize(other.steals_from.size());
+      for (size_t i = 0; i != other.steals_from.size(); ++i) {
+        steal_attempts_from[i] += other.steal_attempts_from[i];
+        steals_from[i] += other.steals_from[i];
+      }
+      return *this;
+    }
+  };
+
+  // Snapshot of counters: one entry per slot (workers, then external slots)
+  // and the last one for threads outside of the pool. Counters aren't
+  // synchronized with workers, so values may be slightly behind.
+  // Empty if the pool is built without EIGEN_POOL_STATS.
+  std::vector<ThreadStats> GetStats() const {
+    std::vector<ThreadStats> result;
+#ifdef EIGEN_POOL_STATS
+    for (auto &counters : counters_) {
+      auto load = [](const std::atomic<uint64_t> &value) {
+        return value.load(std::memory_order_relaxed);
+      };
+      ThreadStats stats;
+      stats.runnext_pops = load(counters->runnext_pops);
+      stats.local_pops = load(counters->local_pops);
+      stats.injected_pops = load(counters->injected_pops);
+      stats.steal_attempts = load(counters->steal_attempts);
+      stats.steals = load(counters->steals);
+      stats.inline_executions = load(counters->inline_executions);
+      stats.idle_loops = load(counters->idle_loops);
+      for (size_t i = 0; i != thread_data_.size(); ++i) {
+        stats.steal_attempts_from.push_back(
+            load(counters->steal_attempts_from[i]));
+        stats.steals_from.push_back(load(counters->steals_from[i]));
+      }
+      result.push_back(std::move(stats));
+    }
+#endif
+    return result;
+  }
+
+  // Events racing with reset may be counted before or after it, the count
+  // of a worker may also survive it.
+  void ResetStats() {
+#ifdef EIGEN_POOL_STATS
+    for (auto &counters : counters_) {
+      counters->Reset(thread_data_.size());
+    }
+#endif
+  }
+
+  enum class WorkerState : uint8_t {
+    RUNNING,  // executing tasks
+    SPINNING, // has nothing to run, looks for work
+    PARKED,   // deactivated by SetActiveThreads, waits in Park
+  };
+
+  // Load of one slot.
+  struct SlotLoad {
+    unsigned queue_size = 0;
+    bool runnext = false; // a task is waiting in runnext
+    WorkerState state = WorkerState::RUNNING;
+  };
+
+  // Queue depths and worker states: one entry per slot (workers, then
+  // external slots). Only relaxed loads, so it can be read at any moment
+  // without slowing workers down, values may be inconsistent with each other.
+  std::vector<SlotLoad> GetLoad() const {
+    std::vector<SlotLoad> result;
+    for (size_t i = 0; i != thread_data_.size(); ++i) {
+      auto &data = thread_data_[i];
+      SlotLoad load;
+      load.queue_size = data.queue.Size();
+#ifdef EIGEN_POOL_RUNNEXT
+      auto next = data.runnext.load(std::memory_order_relaxed);
+      load.runnext = next && next != ThreadData::IDLE;
+#endif
+      load.state = data.state.load(std::memory_order_relaxed);
+      result.push_back(load);
+    }
+    return result;
+  }
+
+  // Approximate number of tasks waiting in the injection queue.
+  size_t InjectedSize() const { return injected_.Size(); }
+
+  // Thread of the pool (or with a leased slot) runs tasks until done()
+  // returns true at a moment it has none, e.g. until all tasks of its loop
+  // are finished, stealing while they are still running somewhere. Other
+  // threads can only wait.
+  template <typename Done> void JoinMainThread(Done &&done) {
     if (CurrentThreadId() == -1) {
+      while (!done()) {
+        std::this_thread::yield();
+      }
       return;
     }
-    WorkerLoop(/* external */ true);
+    WorkerLoop(/* external */ true, done);
+  }
+
+  // returns as soon as the thread has no tasks
+  void JoinMainThread() {
+    JoinMainThread([] { return true; });
   }
 
 private:
@@ -285,11 +556,40 @@ private:
 
   typedef typename Environment::EnvThread Thread;
 
+  // Each alive pool has its own index into thread local PerThread array, so
+  // a thread can be a worker in one pool and external for others (or main
+  // thread in several of them).
+  static constexpr int kMaxPools = 32; // bits in used_pool_indices_
+  static inline std::atomic<uint32_t> used_pool_indices_{0};
+
+  static int AcquirePoolIndex() {
+    auto used = used_pool_indices_.load(std::memory_order_relaxed);
+    while (true) {
+      if (~used == 0) {
+        std::fprintf(stderr, "ThreadPool: more than %d pools alive\n",
+                     kMaxPools);
+        std::abort();
+      }
+      int index = __builtin_ctz(~used);
+      if (used_pool_indices_.compare_exchange_weak(
+              used, used | (1u << index), std::memory_order_acquire)) {
+        return index;
+      }
+    }
+  }
+
+  // unique for every pool, even for ones at the same address and index
+  static inline std::atomic<uint64_t> pool_generations_{0};
+
   struct PerThread {
     constexpr PerThread() : pool(NULL), rand(0), thread_id(-1) {}
     ThreadPoolTempl *pool; // Parent pool, or null for normal threads.
     uint64_t rand;         // Random generator state.
     int thread_id;         // Worker thread index in pool.
+    uint64_t generation = 0; // of the pool this entry was used by
+#ifdef SCHED_TRACE
+    bool idle = false; // failed steals aren't traced while idle
+#endif
   };
 
   struct ThreadData {
@@ -303,6 +603,12 @@ private:
     // pushed
     static inline const TaskPtr IDLE = reinterpret_cast<TaskPtr>(1);
 #endif
+    // owner is in a blocking call, runnext can be stolen
+    std::atomic<bool> blocking{false};
+    // external slot is taken by some thread
+    std::atomic<bool> leased{false};
+    // written by the owner on transitions only, see GetLoad
+    std::atomic<WorkerState> state{WorkerState::RUNNING};
 
     bool PushTask(TaskPtr p, bool useRunnext) {
 #ifdef EIGEN_POOL_RUNNEXT
@@ -310,12 +616,14 @@ private:
         TaskPtr expected = nullptr;
         if (runnext.compare_exchange_strong(expected, p,
                                             std::memory_order_release)) {
+          SCHED_TRACE_POINT(PUSH, Tracing::PUSH_RUNNEXT);
           return true;
         }
-        return queue.PushBack(std::move(p));
-      } else {
-        return queue.PushBack(std::move(p));
       }
+      bool pushed = queue.PushBack(std::move(p));
+      SCHED_TRACE_POINT(PUSH,
+                        pushed ? Tracing::PUSH_QUEUE : Tracing::PUSH_FULL);
+      return pushed;
 #else
       t = queue.PushBack(std::move(t));
 #endif
@@ -338,9 +646,12 @@ private:
       }
     }
 
-    TaskPtr PopFront() {
+    TaskPtr PopFront(bool *fromRunnext = nullptr) {
 #ifdef EIGEN_POOL_RUNNEXT
       if (auto p = PopRunnext(); p && p != IDLE) {
+        if (fromRunnext) {
+          *fromRunnext = true;
+        }
         return p;
       }
 #endif
@@ -349,6 +660,16 @@ private:
 
     TaskPtr PopBack() { return queue.PopBack(); }
 
+    bool Empty() const {
+#ifdef EIGEN_POOL_RUNNEXT
+      auto next = runnext.load(std::memory_order_relaxed);
+      if (next && next != IDLE) {
+        return false;
+      }
+#endif
+      return queue.Empty();
+    }
+
 #ifdef EIGEN_POOL_RUNNEXT
     TaskPtr PopRunnext() {
       if (auto p = runnext.load(std::memory_order_relaxed); p) {
@@ -364,15 +685,80 @@ private:
     TaskPtr StealWithRunnext() {
       TaskPtr t = PopBack();
       if (!t) {
-        t = PopRunnext();
+        // IDLE is owner's state, thief shouldn't reset it
+        if (auto p = runnext.load(std::memory_order_relaxed); p && p != IDLE) {
+          if (runnext.compare_exchange_strong(p, nullptr,
+                                              std::memory_order_acquire)) {
+            t = p;
+          }
+        }
       }
       return t;
     }
 #endif
+
+    TaskPtr Steal() {
+#ifdef EIGEN_POOL_RUNNEXT
+      if (blocking.load(std::memory_order_relaxed)) {
+        return StealWithRunnext();
+      }
+#endif
+      return PopBack();
+    }
+  };
+
+  // Thread executing tasks of a blocked worker. It isn't a worker itself
+  // (CurrentThreadId() is -1), so it never touches the owner's side of the
+  // queue and the owner can come back at any moment.
+  struct Spare {
+    std::condition_variable cv;
+    int slot = -1; // guarded by spare_mutex_, -1 when idle
+    // last, so even implicit destruction joins it before cv is destroyed
+    std::unique_ptr<Thread> thread;
   };
 
+#ifdef EIGEN_POOL_STATS
+  // written by the owner thread only (except for the external one), padded
+  // so counting doesn't cause false sharing
+  struct alignas(64) Counters {
+    explicit Counters(size_t slots)
+        : steal_attempts_from(new std::atomic<uint64_t>[slots]()),
+          steals_from(new std::atomic<uint64_t>[slots]()) {}
+
+    // in place, workers may be counting concurrently
+    void Reset(size_t slots) {
+      for (auto *counter : {&runnext_pops, &local_pops, &injected_pops,
+                            &steal_attempts, &steals, &inline_executions,
+                            &idle_loops}) {
+        counter->store(0, std::memory_order_relaxed);
+      }
+      for (size_t i = 0; i != slots; ++i) {
+        steal_attempts_from[i].store(0, std::memory_order_relaxed);
+        steals_from[i].store(0, std::memory_order_relaxed);
+      }
+    }
+
+    std::atomic<uint64_t> runnext_pops{0};
+    std::atomic<uint64_t> local_pops{0};
+    std::atomic<uint64_t> injected_pops{0};
+    std::atomic<uint64_t> steal_attempts{0};
+    std::atomic<uint64_t> steals{0};
+    std::atomic<uint64_t> inline_executions{0};
+    std::atomic<uint64_t> idle_loops{0};
+    std::unique_ptr<std::atomic<uint64_t>[]> steal_attempts_from;
+    std::unique_ptr<std::atomic<uint64_t>[]> steals_from;
+  };
+#endif
+
+  // slots after num_threads_ in thread_data_, see LeaseExternalSlot
+  static constexpr int kExternalSlots = 8;
+
   Environment env_;
+  const int pool_index_;
+  const uint64_t generation_;
   const int num_threads_;
+  std::atomic<int> active_threads_;
+  std::atomic<int> leased_slots_{0};
   const bool allow_spinning_;
   MaxSizeVector<ThreadData> thread_data_;
   MaxSizeVector<MaxSizeVector<unsigned>> all_coprimes_;
@@ -381,31 +767,221 @@ private:
   std::atomic<bool> spinning_;
   std::atomic<bool> done_;
   std::atomic<bool> cancelled_;
+  const std::thread::native_handle_type main_native_handle_;
+  std::mutex park_mutex_;
+  std::condition_variable park_cv_;
+  std::mutex spare_mutex_;
+  std::vector<std::unique_ptr<Spare>> spares_; // guarded by spare_mutex_
+  static constexpr unsigned kInjectBatch = 4;
+  InjectionQueue<TaskPtr, 1024> injected_;
+#ifdef EIGEN_POOL_STATS
+  std::vector<std::unique_ptr<Counters>> counters_;
+
+  Counters &CountersOf(PerThread *pt) {
+    return pt->pool == this ? *counters_[pt->thread_id] : *counters_.back();
+  }
+
+  // slot's counters have a single writer, so a plain store is enough, only
+  // the shared ones need an atomic add
+  void CountStat(const Counters &counters, std::atomic<uint64_t> &counter,
+                 uint64_t value) {
+    if (&counters == counters_.back().get()) {
+      counter.fetch_add(value, std::memory_order_relaxed);
+    } else {
+      counter.store(counter.load(std::memory_order_relaxed) + value,
+                    std::memory_order_relaxed);
+    }
+  }
+#endif
+
+  // Tasks can still be pushed to a parked worker by someone who has read
+  // active_threads_ before it was decreased, so parked workers recheck their
+  // queue periodically.
+  static constexpr auto kParkRecheck = std::chrono::milliseconds(1);
+
+  void Park(int thread_id) {
+    std::unique_lock<std::mutex> lock(park_mutex_);
+    thread_data_[thread_id].state.store(WorkerState::PARKED,
+                                        std::memory_order_relaxed);
+    while (thread_id >= NumActiveThreads() && !done_ &&
+           thread_data_[thread_id].Empty()) {
+      park_cv_.wait_for(lock, kParkRecheck);
+    }
+  }
+
+  void WakeParked() {
+    {
+      std::lock_guard<std::mutex> lock(park_mutex_);
+    }
+    park_cv_.notify_all();
+  }
+
+  void ActivateSpare(int slot) {
+    std::lock_guard<std::mutex> lock(spare_mutex_);
+    Spare *idle = nullptr;
+    for (auto &spare : spares_) {
+      if (spare->slot == slot) {
+        return; // previous one hasn't retired yet
+      }
+      if (spare->slot == -1 && !idle) {
+        idle = spare.get();
+      }
+    }
+    if (!idle) {
+      spares_.push_back(std::make_unique<Spare>());
+      idle = spares_.back().get();
+      idle->thread.reset(env_.CreateThread([this, idle]() { SpareLoop(idle); }));
+    }
+    idle->slot = slot;
+    idle->cv.notify_one();
+  }
+
+  void SpareLoop(Spare *spare) {
+    GetPerThread()->rand = GlobalThreadIdHash();
+    std::unique_lock<std::mutex> lock(spare_mutex_);
+    while (true) {
+      spare->cv.wait(lock, [&] { return spare->slot != -1 || done_; });
+      if (done_) {
+        return;
+      }
+      int slot = spare->slot;
+      lock.unlock();
+      // take place of the blocked worker
+      cpu_set_t cpus;
+      if (slot < num_threads_ &&
+          pthread_getaffinity_np(NativeHandle(slot), sizeof(cpus), &cpus) ==
+              0) {
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+      }
+      auto &data = thread_data_[slot];
+      while (!cancelled_ && !done_) {
+        if (!data.blocking.load(std::memory_order_acquire)) {
+          // recheck under lock, so EnterBlocking either sees us retired or
+          // we see it blocked again
+          lock.lock();
+          if (!data.blocking.load(std::memory_order_relaxed)) {
+            break;
+          }
+          lock.unlock();
+        }
+        TaskPtr t = data.Steal();
+        EIGEN_POOL_STAT(*counters_.back(), steal_attempts, 1);
+        if (t) {
+          EIGEN_POOL_STAT(*counters_.back(), steals, 1);
+          EIGEN_POOL_STAT(*counters_.back(), steals_from[slot], 1);
+        } else if (injected_.PopBatch(&t, 1)) {
+          EIGEN_POOL_STAT(*counters_.back(), injected_pops, 1);
+        }
+        if (!t) {
+          t = GlobalSteal();
+        }
+        if (t) {
+          ExecuteTask(t);
+        } else {
+          std::this_thread::yield();
+        }
+      }
+      if (!lock.owns_lock()) {
+        lock.lock();
+      }
+      spare->slot = -1;
+    }
+  }
 
-  // Main worker thread loop.
-  void WorkerLoop(bool external = false) {
+  // Main worker thread loop, external one exits when there are no tasks and
+  // done() is true.
+  template <typename Done> void WorkerLoop(bool external, Done &&done) {
     PerThread *pt = GetPerThread();
     auto thread_id = pt->thread_id;
     auto &threadData = thread_data_[thread_id];
     threadData.ResetIdle();
+#ifdef SCHED_TRACE
+    pt->idle = false;
+#endif
     while (!cancelled_) {
+      // deactivated worker only drains its own queue
+      bool active = external || thread_id < NumActiveThreads();
+#ifdef EIGEN_POOL_STATS
+      auto &counters = *counters_[thread_id];
+      bool fromRunnext = false;
+      TaskPtr t = threadData.PopFront(&fromRunnext);
+      if (fromRunnext) {
+        EIGEN_POOL_STAT(counters, runnext_pops, 1);
+      } else if (t) {
+        EIGEN_POOL_STAT(counters, local_pops, 1);
+      }
+#else
       TaskPtr t = threadData.PopFront();
-      if (!t) {
+#endif
+      if (!t && active) {
         t = LocalSteal();
       }
-      if (!t) {
+      if (!t && active) {
+        t = PopInjected(threadData);
+      }
+      if (!t && active) {
         t = GlobalSteal();
       }
-      if (!t && external && threadData.SetIdle()) {
-        // external thread shouldn't wait for work, it should just exit.
+      if (!t && external && done() && threadData.SetIdle()) {
+        // external thread shouldn't wait for more work, it should just exit.
+        EndIdleTrace(pt);
         return;
       }
+      auto state = t ? WorkerState::RUNNING : WorkerState::SPINNING;
+      if (threadData.state.load(std::memory_order_relaxed) != state) {
+        threadData.state.store(state, std::memory_order_relaxed);
+      }
+#ifdef SCHED_TRACE
+      if (!t != pt->idle) {
+        pt->idle = !t;
+        if (t) {
+          SCHED_TRACE_POINT(IDLE_END, 0);
+        } else {
+          SCHED_TRACE_POINT(IDLE_START, 0);
+        }
+      }
+#endif
       if (t) {
         ExecuteTask(t);
       } else if (done_) {
+        EndIdleTrace(pt);
         return;
+      } else {
+        EIGEN_POOL_STAT(counters, idle_loops, 1);
+        if (!active) {
+          Park(thread_id);
+        }
+      }
+    }
+  }
+
+  // so every IDLE_START in the trace gets its IDLE_END
+  void EndIdleTrace([[maybe_unused]] PerThread *pt) {
+#ifdef SCHED_TRACE
+    if (pt->idle) {
+      pt->idle = false;
+      SCHED_TRACE_POINT(IDLE_END, 0);
+    }
+#endif
+  }
+
+  // Takes a fair share (up to kInjectBatch) of injected tasks: runs the first
+  // one and keeps the others in its own queue, where they can be stolen.
+  TaskPtr PopInjected(ThreadData &threadData) {
+    if (injected_.Empty()) {
+      return nullptr;
+    }
+    TaskPtr batch[kInjectBatch];
+    unsigned share = injected_.Size() / NumActiveThreads() + 1;
+    unsigned count = injected_.PopBatch(batch, std::min(share, kInjectBatch));
+    EIGEN_POOL_STAT(CountersOf(GetPerThread()), injected_pops, count);
+    for (unsigned i = 1; i < count; ++i) {
+      if (!threadData.queue.PushFront(batch[i])) {
+        EIGEN_POOL_STAT(CountersOf(GetPerThread()), inline_executions, 1);
+        ExecuteTask(batch[i]);
       }
     }
+    return count ? batch[0] : nullptr;
   }
 
   // Steal tries to steal work from other worker threads in the range [start,
@@ -424,8 +1000,18 @@ private:
 
     for (unsigned i = 0; i < size; i++) {
       assert(start + victim < limit);
-      TaskPtr t = thread_data_[start + victim].PopBack();
+      TaskPtr t = thread_data_[start + victim].Steal();
+#ifdef EIGEN_POOL_STATS
+      auto &counters = CountersOf(pt);
+      EIGEN_POOL_STAT(counters, steal_attempts, 1);
+      EIGEN_POOL_STAT(counters, steal_attempts_from[start + victim], 1);
       if (t) {
+        EIGEN_POOL_STAT(counters, steals, 1);
+        EIGEN_POOL_STAT(counters, steals_from[start + victim], 1);
+      }
+#endif
+      if (t) {
+        SCHED_TRACE_POINT(STEAL, start + victim);
         return t;
       }
       victim += inc;
@@ -433,6 +1019,11 @@ private:
         victim -= size;
       }
     }
+#ifdef SCHED_TRACE
+    if (!pt->idle) {
+      SCHED_TRACE_POINT(STEAL_FAILED, size);
+    }
+#endif
     return nullptr;
   }
 
@@ -447,12 +1038,23 @@ private:
     unsigned start, limit;
     DecodePartition(partition, &start, &limit);
     AssertBounds(start, limit);
+    limit = std::min(limit, static_cast<unsigned>(NumActiveThreads()));
+    if (start >= limit) {
+      return nullptr;
+    }
 
     return Steal(start, limit);
   }
 
-  // Steals work from any other thread in the pool.
-  TaskPtr GlobalSteal() { return Steal(0, num_threads_); }
+  // Steals work from any other active thread in the pool, including leased
+  // external slots.
+  TaskPtr GlobalSteal() {
+    TaskPtr t = Steal(0, NumActiveThreads());
+    if (!t && leased_slots_.load(std::memory_order_relaxed) != 0) {
+      t = Steal(num_threads_, num_threads_ + kExternalSlots);
+    }
+    return t;
+  }
 
   int NonEmptyQueueIndex() {
     PerThread *pt = GetPerThread();
@@ -480,8 +1082,13 @@ private:
   }
 
   __attribute__((always_inline)) inline PerThread *GetPerThread() {
-    static thread_local PerThread per_thread_;
-    PerThread *pt = &per_thread_;
+    static thread_local PerThread per_thread_[kMaxPools];
+    PerThread *pt = &per_thread_[pool_index_];
+    if (__builtin_expect(pt->generation != generation_, 0)) {
+      // left by a destroyed pool which had the same index
+      *pt = PerThread();
+      pt->generation = generation_;
+    }
     return pt;
   }
 
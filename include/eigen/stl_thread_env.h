@@ -13,6 +13,10 @@ struct StlThreadEnvironment {
     // This function is called when the threadpool is cancelled.
     void OnCancel() {}
 
+    std::thread::native_handle_type NativeHandle() {
+      return thr_.native_handle();
+    }
+
   private:
     std::thread thr_;
   };
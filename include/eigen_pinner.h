@@ -1,6 +1,8 @@
 #pragma once
 #include "eigen_pool.h"
 #include "poor_barrier.h"
+#include <algorithm>
+#include <vector>
 
 #if defined(EIGEN_MODE) && EIGEN_MODE != EIGEN_RAPID
 
@@ -19,6 +21,19 @@ struct EigenPinner {
     PinThread(0);
     barrier->Wait();
   }
+
+  // Pins i'th worker to cpus[i] through native handles, so can be called from
+  // any thread while pool is busy.
+  static void PinWorkers(Eigen::ThreadPool &pool, const std::vector<int> &cpus) {
+    auto count = std::min<size_t>(cpus.size(), pool.NumThreads());
+    for (size_t i = 0; i != count; ++i) {
+      PinThreadToCpu(pool.NativeHandle(i), cpus[i]);
+    }
+  }
+
+  static void PinWorkers(const std::vector<int> &cpus) {
+    PinWorkers(EigenPool, cpus);
+  }
 };
 
 #endif
@@ -15,21 +15,54 @@ inline auto EigenPool = Eigen::ThreadPool(GetNumThreads(), true,
                                           true); // todo: disable spinning?
 #endif
 
-class EigenPoolWrapper {
+// Scheduler for EigenPartitioner on the given pool. Pools are isolated: a
+// thread has its own identity in each of them, so separate pools (e.g. for
+// latency critical and batch work, pinned with EigenPinner::PinWorkers to
+// different cpus) can be used in one process:
+//   inline Eigen::ThreadPool BatchPool(8, true, true);
+//   EigenPartitioner::ParallelForTimespan<EigenArenaWrapper<BatchPool>, ...>
+// The thread creating a pool is its thread 0.
+template <Eigen::ThreadPool &Pool> class EigenArenaWrapper {
 public:
+  // thread outside of the pool works in an external slot until the loop ends
+  EigenArenaWrapper() : Leased_(Pool.LeaseExternalSlot()) {}
+
+  ~EigenArenaWrapper() {
+    if (Leased_) {
+      Pool.ReleaseExternalSlot();
+    }
+  }
+
+  EigenArenaWrapper(const EigenArenaWrapper &) = delete;
+  EigenArenaWrapper &operator=(const EigenArenaWrapper &) = delete;
+
   template <typename F> void run(F &&f) {
-    EigenPool.Schedule(Eigen::MakeTask(std::forward<F>(f)));
+    Pool.Schedule(Eigen::MakeTask(std::forward<F>(f)));
   }
 
   template <typename F> void run_on_thread(F &&f, size_t hint) {
-    EigenPool.RunOnThread(Eigen::MakeTask(std::forward<F>(f)), hint);
+    Pool.RunOnThread(Eigen::MakeTask(std::forward<F>(f)), hint);
   }
 
-  void join_main_thread() { EigenPool.JoinMainThread(); }
+  // runs and steals tasks until done() is true
+  template <typename Done> void join_main_thread(Done &&done) {
+    Pool.JoinMainThread(std::forward<Done>(done));
+  }
+
+  // live value, changes with Pool.SetActiveThreads
+  size_t num_threads() { return Pool.NumActiveThreads(); }
+
+  // slot of the calling thread in Pool, -1 outside of it
+  int thread_index() { return Pool.CurrentThreadId(); }
 
   void wait() {
     // TODO: implement
   }
+
+private:
+  bool Leased_;
 };
 
+using EigenPoolWrapper = EigenArenaWrapper<EigenPool>;
+
 #endif
@@ -0,0 +1,159 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+
+// Log-linear histogram, as HdrHistogram: values below 2^SUB_BITS are exact,
+// larger ones go to 2^(SUB_BITS - 1) linear sub-buckets of their power of two,
+// so a value is off by less than 2^(1 - SUB_BITS) (1.6%). Memory is fixed
+// (30KB), so it can record runs of any length.
+//
+// Record is for a single writer (other threads may read or merge at the same
+// time), RecordShared is for any number of them.
+class Histogram {
+public:
+  static constexpr unsigned SUB_BITS = 7;
+  static constexpr size_t HALF = size_t(1) << (SUB_BITS - 1);
+  static constexpr size_t BUCKETS = (64 - SUB_BITS + 2) * HALF;
+
+  static size_t Index(uint64_t value) {
+    if (value < 2 * HALF) {
+      return value;
+    }
+    unsigned shift = 63 - __builtin_clzll(value) - (SUB_BITS - 1);
+    return shift * HALF + (value >> shift);
+  }
+
+  // the largest value with the same index
+  static uint64_t HighestEquivalent(size_t index) {
+    if (index < 2 * HALF) {
+      return index;
+    }
+    unsigned shift = index / HALF - 1;
+    uint64_t mantissa = index - shift * HALF;
+    return ((mantissa + 1) << shift) - 1;
+  }
+
+  void Record(uint64_t value) {
+    auto &count = Counts_[Index(value)];
+    count.store(count.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+    Total_.store(Total_.load(std::memory_order_relaxed) + 1,
+                 std::memory_order_relaxed);
+    if (value > Max_.load(std::memory_order_relaxed)) {
+      Max_.store(value, std::memory_order_relaxed);
+    }
+    if (value < Min_.load(std::memory_order_relaxed)) {
+      Min_.store(value, std::memory_order_relaxed);
+    }
+  }
+
+  void RecordShared(uint64_t value) {
+    Counts_[Index(value)].fetch_add(1, std::memory_order_relaxed);
+    Total_.fetch_add(1, std::memory_order_relaxed);
+    AtomicMax(Max_, value);
+    AtomicMin(Min_, value);
+  }
+
+  // adds other's counts, other may be written concurrently
+  void Merge(const Histogram &other) {
+    for (size_t i = 0; i != BUCKETS; ++i) {
+      if (auto count = other.Counts_[i].load(std::memory_order_relaxed)) {
+        Counts_[i].fetch_add(count, std::memory_order_relaxed);
+        Total_.fetch_add(count, std::memory_order_relaxed);
+      }
+    }
+    AtomicMax(Max_, other.Max_.load(std::memory_order_relaxed));
+    AtomicMin(Min_, other.Min_.load(std::memory_order_relaxed));
+  }
+
+  uint64_t Count() const { return Total_.load(std::memory_order_relaxed); }
+
+  uint64_t Max() const { return Max_.load(std::memory_order_relaxed); }
+
+  uint64_t Min() const {
+    return Count() ? Min_.load(std::memory_order_relaxed) : 0;
+  }
+
+  // value at or below which q of recorded values are, up to bucket precision
+  uint64_t Quantile(double q) const {
+    auto total = Count();
+    if (total == 0) {
+      return 0;
+    }
+    auto rank = std::max<uint64_t>(1, std::ceil(q * total));
+    uint64_t seen = 0;
+    for (size_t i = 0; i != BUCKETS; ++i) {
+      seen += Counts_[i].load(std::memory_order_relaxed);
+      if (seen >= rank) {
+        return std::min(HighestEquivalent(i), Max());
+      }
+    }
+    return Max();
+  }
+
+  // {"count": .., "p50": .., "p95": .., "p99": .., "p99.9": .., "max": ..}
+  void PrintQuantiles(std::ostream &out) const {
+    out << "{\"count\": " << Count() << ", \"p50\": " << Quantile(0.5)
+        << ", \"p95\": " << Quantile(0.95) << ", \"p99\": " << Quantile(0.99)
+        << ", \"p99.9\": " << Quantile(0.999) << ", \"max\": " << Max()
+        << "}";
+  }
+
+private:
+  static void AtomicMax(std::atomic<uint64_t> &value, uint64_t x) {
+    auto current = value.load(std::memory_order_relaxed);
+    while (x > current && !value.compare_exchange_weak(
+                              current, x, std::memory_order_relaxed)) {
+    }
+  }
+
+  static void AtomicMin(std::atomic<uint64_t> &value, uint64_t x) {
+    auto current = value.load(std::memory_order_relaxed);
+    while (x < current && !value.compare_exchange_weak(
+                              current, x, std::memory_order_relaxed)) {
+    }
+  }
+
+  std::array<std::atomic<uint64_t>, BUCKETS> Counts_{};
+  std::atomic<uint64_t> Total_{0};
+  std::atomic<uint64_t> Max_{0};
+  std::atomic<uint64_t> Min_{UINT64_MAX};
+};
+
+// One histogram per thread slot, slots past the last one share an extra
+// histogram. Merged only when read.
+class HistogramSet {
+public:
+  explicit HistogramSet(size_t threads)
+      : Threads_(threads), Slots_(new Slot[threads + 1]) {}
+
+  void Record(size_t slot, uint64_t value) {
+    if (slot < Threads_) {
+      Slots_[slot].Value.Record(value);
+    } else {
+      Slots_[Threads_].Value.RecordShared(value);
+    }
+  }
+
+  std::unique_ptr<Histogram> Merged() const {
+    auto merged = std::make_unique<Histogram>();
+    for (size_t i = 0; i <= Threads_; ++i) {
+      merged->Merge(Slots_[i].Value);
+    }
+    return merged;
+  }
+
+private:
+  struct alignas(64) Slot {
+    Histogram Value;
+  };
+
+  const size_t Threads_;
+  std::unique_ptr<Slot[]> Slots_;
+};
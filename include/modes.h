@@ -13,6 +13,8 @@ inline std::string GetParallelMode() {
   return STR(OMP_MODE);
 #elif defined(EIGEN_MODE)
   return STR(EIGEN_MODE);
+#elif defined(PROACTIVE_MODE)
+  return STR(PROACTIVE_MODE);
 #else
   static_assert(false, "Unsupported mode");
 #endif
@@ -24,18 +26,26 @@ inline std::string GetParallelMode() {
 #define OMP_GUIDED_MONOTONIC 4
 #define OMP_GUIDED_NONMONOTONIC 5
 #define OMP_RUNTIME 6
+#define OMP_TASKLOOP 7
 
 #define TBB_SIMPLE 1
 #define TBB_AUTO 2
 #define TBB_AFFINITY 3
 #define TBB_CONST_AFFINITY 4
 #define TBB_RAPID 5
+#define TBB_TIMESPAN 6
 
 #define EIGEN_SIMPLE 1
 #define EIGEN_RAPID 2
 #define EIGEN_TIMESPAN 3
 #define EIGEN_STATIC 4
 #define EIGEN_TIMESPAN_GRAINSIZE 5
+#define EIGEN_GUIDED 6
+#define EIGEN_FACTORING 7
+#define EIGEN_AWF 8
+#define EIGEN_HEARTBEAT 9
+
+#define PROACTIVE_STATIC 1
 
 #ifdef TBB_MODE
 #include <tbb/parallel_for.h>
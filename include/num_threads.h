@@ -1,9 +1,10 @@
 #pragma once
 
+#include "available_cpus.h"
 #include "modes.h"
+#include <algorithm>
 #include <cstddef>
 #include <string>
-#include <thread>
 
 inline int GetNumThreads() {
   // cache result to avoid calling getenv on every call
@@ -16,14 +17,20 @@ inline int GetNumThreads() {
       return std::stoi(envThreads);
     }
 #if defined(TBB_MODE)
-    return tbb::info::
-        default_concurrency(); // tbb::this_task_arena::max_concurrency();
+    // tbb respects affinity mask, but not cgroup quota
+    return std::min(tbb::info::default_concurrency(),
+                    GetAvailableConcurrency());
 #elif defined(OMP_MODE)
-    return omp_get_max_threads();
+    // query our limit before omp runtime gets a chance to bind main thread
+    int available = GetAvailableConcurrency();
+    if (std::getenv("OMP_NUM_THREADS")) {
+      return omp_get_max_threads();
+    }
+    return std::min(omp_get_max_threads(), available);
 #elif defined(SERIAL)
     return 1;
-#elif defined(EIGEN_MODE)
-    return std::thread::hardware_concurrency();
+#elif defined(EIGEN_MODE) || defined(PROACTIVE_MODE)
+    return GetAvailableConcurrency();
 #else
     static_assert(false, "Unsupported mode");
 #endif
@@ -1,8 +1,11 @@
 #pragma once
 
+#include "blocking_region.h"
 #include "eigen_pool.h"
 #include "modes.h"
+#include "pool_metrics.h"
 #include "poor_barrier.h"
+#include "self_scheduling_partitioner.h"
 #include "timespan_partitioner.h"
 #include "util.h"
 #include <vector>
@@ -21,6 +24,7 @@ inline Harness::RapidStart<EigenPoolWrapper> RapidGroup;
 #endif
 
 #ifdef TBB_MODE
+#include "tbb_arena_scheduler.h"
 #include "tbb_pinner.h"
 #endif
 
@@ -37,22 +41,36 @@ struct InitOnce {
 #ifdef EIGEN_MODE
 // TODO: move to eigen header
 template <typename F>
-inline void EigenParallelFor(size_t from, size_t to, F &&func) {
+inline void EigenParallelFor(size_t from, size_t to, F &&func,
+                             size_t grainSize = 1) {
 #if EIGEN_MODE == EIGEN_SIMPLE
-  EigenPartitioner::ParallelForSimple<EigenPoolWrapper>(from, to,
-                                                        std::forward<F>(func));
+  EigenPartitioner::ParallelForSimple<EigenPoolWrapper>(
+      from, to, std::forward<F>(func), grainSize);
 #elif EIGEN_MODE == EIGEN_TIMESPAN
   EigenPartitioner::ParallelForTimespan<EigenPoolWrapper,
                                         EigenPartitioner::GrainSize::DEFAULT>(
-      from, to, std::forward<F>(func));
+      from, to, std::forward<F>(func), grainSize);
 #elif EIGEN_MODE == EIGEN_TIMESPAN_GRAINSIZE
   EigenPartitioner::ParallelForTimespan<EigenPoolWrapper,
                                         EigenPartitioner::GrainSize::AUTO>(
-      from, to, std::forward<F>(func));
+      from, to, std::forward<F>(func), grainSize);
 #elif EIGEN_MODE == EIGEN_STATIC
-  EigenPartitioner::ParallelForStatic<EigenPoolWrapper>(from, to,
-                                                        std::forward<F>(func));
+  EigenPartitioner::ParallelForStatic<EigenPoolWrapper>(
+      from, to, std::forward<F>(func), grainSize);
+#elif EIGEN_MODE == EIGEN_GUIDED
+  EigenPartitioner::ParallelForGuided<EigenPoolWrapper>(
+      from, to, std::forward<F>(func), grainSize);
+#elif EIGEN_MODE == EIGEN_FACTORING
+  EigenPartitioner::ParallelForFactoring<EigenPoolWrapper>(
+      from, to, std::forward<F>(func), grainSize);
+#elif EIGEN_MODE == EIGEN_AWF
+  EigenPartitioner::ParallelForAdaptiveWeighted<EigenPoolWrapper>(
+      from, to, std::forward<F>(func), grainSize);
+#elif EIGEN_MODE == EIGEN_HEARTBEAT
+  EigenPartitioner::ParallelForHeartbeat<EigenPoolWrapper>(
+      from, to, std::forward<F>(func), grainSize);
 #elif EIGEN_MODE == EIGEN_RAPID
+  // rapid start splits range between threads equally, no grain size
   RapidGroup.parallel_ranges(from, to, [&func](auto from, auto to, auto part) {
     for (size_t i = from; i != to; ++i) {
       func(i);
@@ -79,6 +97,7 @@ inline void GetHugePseudoIterator() {
 // TODO: move out some initializations from body to avoid init overhead?
 template <typename Func>
 void ParallelFor(size_t from, size_t to, Func &&func, size_t grainSize = 1) {
+  Metrics::ParallelForScope metrics;
 #if defined(SERIAL)
   for (size_t i = from; i < to; ++i) {
     func(i);
@@ -107,21 +126,27 @@ void ParallelFor(size_t from, size_t to, Func &&func, size_t grainSize = 1) {
   static tbb::affinity_partitioner part;
 #elif TBB_MODE == TBB_CONST_AFFINITY
   tbb::affinity_partitioner part;
-#elif TBB_MODE == TBB_RAPID
+#elif TBB_MODE == TBB_RAPID || TBB_MODE == TBB_TIMESPAN
   // no partitioner
 #else
   static_assert(false, "Wrong TBB_MODE mode");
 #endif
-  // TODO: grain size?
 #if TBB_MODE == TBB_RAPID
   RapidGroup.parallel_ranges(from, to, [&](auto from, auto to, auto part) {
     for (size_t i = from; i != to; ++i) {
       func(i);
     }
   });
+#elif TBB_MODE == TBB_TIMESPAN
+  // same partitioner as EIGEN_TIMESPAN_GRAINSIZE, but on tbb workers
+  TbbArena.execute([&] {
+    EigenPartitioner::ParallelForTimespan<TbbArenaScheduler,
+                                          EigenPartitioner::GrainSize::AUTO>(
+        from, to, func, grainSize);
+  });
 #else
   tbb::parallel_for(
-      tbb::blocked_range(from, to),
+      tbb::blocked_range<size_t>(from, to, std::max<size_t>(grainSize, 1)),
       [&](const tbb::blocked_range<size_t> &range) {
         for (size_t i = range.begin(); i != range.end(); ++i) {
           func(i);
@@ -129,21 +154,53 @@ void ParallelFor(size_t from, size_t to, Func &&func, size_t grainSize = 1) {
       },
       part, context);
 #endif
+#elif OMP_MODE == OMP_TASKLOOP
+  // outermost call opens the team, nested calls become tasks on the same team
+  // instead of creating new teams; default grain gives a few tasks per thread
+  auto threads = static_cast<size_t>(omp_get_max_threads());
+  size_t chunk =
+      std::max(grainSize, (to - from + 4 * threads - 1) / (4 * threads));
+  auto taskloop = [&] {
+#pragma omp taskloop grainsize(chunk)
+    for (size_t i = from; i < to; ++i) {
+      func(i);
+    }
+  };
+  if (omp_in_parallel()) {
+    taskloop();
+  } else {
+#pragma omp parallel
+#pragma omp single
+    taskloop();
+  }
 #elif defined(OMP_MODE)
+  // chunk size for dynamic and minimal chunk for guided
+  [[maybe_unused]] size_t chunk = std::max<size_t>(grainSize, 1);
+#if OMP_MODE == OMP_STATIC
+  auto threads = static_cast<size_t>(omp_get_max_threads());
+  if (chunk > (to - from + threads - 1) / threads) {
+    // blocks of the even split would be smaller than grainSize
+#pragma omp parallel for schedule(static, static_cast<int>(chunk))
+    for (size_t i = from; i < to; ++i) {
+      func(i);
+    }
+    return;
+  }
+#endif
 #pragma omp parallel
 #if OMP_MODE == OMP_STATIC
 #pragma omp for schedule(static)
 #elif OMP_MODE == OMP_RUNTIME
+  // chunk is taken from OMP_SCHEDULE
 #pragma omp for schedule(runtime)
 #elif OMP_MODE == OMP_DYNAMIC_MONOTONIC
-// TODO: chunk size?
-#pragma omp for schedule(monotonic : dynamic)
+#pragma omp for schedule(monotonic : dynamic, static_cast<int>(chunk))
 #elif OMP_MODE == OMP_DYNAMIC_NONMONOTONIC
-#pragma omp for schedule(nonmonotonic : dynamic)
+#pragma omp for schedule(nonmonotonic : dynamic, static_cast<int>(chunk))
 #elif OMP_MODE == OMP_GUIDED_MONOTONIC
-#pragma omp for schedule(monotonic : guided)
+#pragma omp for schedule(monotonic : guided, static_cast<int>(chunk))
 #elif OMP_MODE == OMP_GUIDED_NONMONOTONIC
-#pragma omp for schedule(nonmonotonic : guided)
+#pragma omp for schedule(nonmonotonic : guided, static_cast<int>(chunk))
 #else
   static_assert(false, "Wrong OMP_MODE mode");
 #endif
@@ -151,7 +208,16 @@ void ParallelFor(size_t from, size_t to, Func &&func, size_t grainSize = 1) {
     func(i);
   }
 #elif defined(EIGEN_MODE)
-  EigenParallelFor(from, to, func);
+  EigenParallelFor(from, to, func, grainSize);
+#elif PROACTIVE_MODE == PROACTIVE_STATIC
+  ProactivePool.Run(
+      from, to,
+      [&func](size_t from, size_t to) {
+        for (size_t i = from; i != to; ++i) {
+          func(i);
+        }
+      },
+      grainSize);
 #else
   static_assert(false, "Wrong mode");
 #endif
@@ -166,6 +232,17 @@ inline void Warmup(size_t threadsNum) {
 }
 
 inline void InitParallel(size_t threadsNum) {
+  if (const char *socket = std::getenv("POOL_METRICS_SOCKET")) {
+    static Metrics::Reporter reporter(socket, threadsNum
+#ifdef EIGEN_MODE
+                                      ,
+                                      [](Metrics::Exposition &out) {
+                                        Metrics::WritePoolMetrics(EigenPool,
+                                                                  out);
+                                      }
+#endif
+    );
+  }
 #if TBB_MODE == TBB_RAPID || EIGEN_MODE == EIGEN_RAPID
   static InitOnce rapidInit{[threadsNum]() { RapidGroup.init(threadsNum); }};
 #endif
@@ -193,6 +270,12 @@ inline void InitParallel(size_t threadsNum) {
   static EigenPinner pinner(threadsNum);
 #endif
 #endif
+#ifdef PROACTIVE_MODE
+  // static split of threadsNum iterations runs i'th one on i'th thread
+  static InitOnce pinner{[threadsNum]() {
+    ParallelFor(0, threadsNum, [](size_t i) { PinThread(i); });
+  }};
+#endif
 #if OMP_MODE == OMP_RUNTIME
   // lb4omp doesn't work well with barrier :(
   static InitOnce warmup{[threadsNum]() {
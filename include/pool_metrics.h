@@ -0,0 +1,318 @@
+#pragma once
+#include "clock.h"
+#include "histogram.h"
+#include "util.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <poll.h>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+// Live scheduler metrics in Prometheus text format, served over a Unix
+// socket: every connection gets current values and is closed, e.g.
+//   curl --unix-socket /tmp/pool.sock http://localhost/metrics
+//   socat - UNIX-CONNECT:/tmp/pool.sock
+// InitParallel starts a reporter if POOL_METRICS_SOCKET is set. Values are
+// only loaded (relaxed) by the reporter thread, workers never wait for it.
+namespace Metrics {
+
+// Calls and latency of ParallelFor, counted while a reporter exists.
+class ParallelForStats {
+public:
+  explicit ParallelForStats(size_t threads)
+      : Latency_(threads), Threads_(threads), Sums_(new Sum[threads + 1]) {}
+
+  // stats calls are counted into, null if there is no reporter
+  static std::atomic<ParallelForStats *> &Active() {
+    static std::atomic<ParallelForStats *> active{nullptr};
+    return active;
+  }
+
+  // slots past the threads share the last one
+  void Record(size_t slot, Timestamp latency) {
+    Latency_.Record(slot, latency);
+    Sums_[std::min(slot, Threads_)].Ticks.fetch_add(latency,
+                                                    std::memory_order_relaxed);
+  }
+
+  std::unique_ptr<Histogram> Latency() const { return Latency_.Merged(); }
+
+  uint64_t LatencySum() const {
+    uint64_t sum = 0;
+    for (size_t i = 0; i <= Threads_; ++i) {
+      sum += Sums_[i].Ticks.load(std::memory_order_relaxed);
+    }
+    return sum;
+  }
+
+private:
+  struct alignas(64) Sum {
+    std::atomic<uint64_t> Ticks{0};
+  };
+
+  HistogramSet Latency_;
+  const size_t Threads_;
+  std::unique_ptr<Sum[]> Sums_;
+};
+
+// Measures the enclosing ParallelFor call if stats are active.
+class ParallelForScope {
+public:
+  ParallelForScope()
+      : Stats_(ParallelForStats::Active().load(std::memory_order_acquire)),
+        Start_(Stats_ ? Now() : 0) {}
+
+  ~ParallelForScope() {
+    if (Stats_) {
+      Stats_->Record(OwnSlot(), Now() - Start_);
+    }
+  }
+
+  ParallelForScope(const ParallelForScope &) = delete;
+  ParallelForScope &operator=(const ParallelForScope &) = delete;
+
+private:
+  // Only workers of EigenPool own a slot. Thread numbers of other runtimes
+  // repeat across teams and callers, so those threads share the last one.
+  static size_t OwnSlot() {
+#if defined(EIGEN_MODE)
+    if (auto id = EigenPool.CurrentThreadId(); id >= 0) {
+      return id;
+    }
+#endif
+    return std::numeric_limits<size_t>::max();
+  }
+
+  ParallelForStats *const Stats_;
+  const Timestamp Start_;
+};
+
+// One scrape in the text exposition format. Every counter also gets a
+// `<name>_per_second` gauge: its rate since the previous scrape.
+class Exposition {
+public:
+  Exposition(std::ostream &out,
+             std::unordered_map<std::string, double> &previous,
+             double interval)
+      : Out_(out), Previous_(previous), Interval_(interval) {}
+
+  void Family(const std::string &name, const char *type, const char *help) {
+    Out_ << "# HELP " << name << " " << help << "\n"
+         << "# TYPE " << name << " " << type << "\n";
+  }
+
+  // labels are `key="value",...` without braces
+  void Sample(const std::string &name, double value,
+              const std::string &labels = "") {
+    Out_ << name;
+    if (!labels.empty()) {
+      Out_ << "{" << labels << "}";
+    }
+    Out_ << " " << value << "\n";
+  }
+
+  void Gauge(const std::string &name, const char *help, double value) {
+    Family(name, "gauge", help);
+    Sample(name, value);
+  }
+
+  void Counter(const std::string &name, const char *help, double value) {
+    Family(name + "_total", "counter", help);
+    Sample(name + "_total", value);
+    auto [previous, first] = Previous_.emplace(name, value);
+    if (!first && Interval_ > 0) {
+      Family(name + "_per_second", "gauge", "rate since the previous scrape");
+      Sample(name + "_per_second", (value - previous->second) / Interval_);
+    }
+    previous->second = value;
+  }
+
+private:
+  std::ostream &Out_;
+  std::unordered_map<std::string, double> &Previous_;
+  const double Interval_;
+};
+
+// Queue depths and worker states of EigenPool-like pools (see GetLoad),
+// steal counters if it's built with EIGEN_POOL_STATS.
+template <typename Pool>
+void WritePoolMetrics(const Pool &pool, Exposition &out) {
+  auto load = pool.GetLoad();
+  auto workers = static_cast<size_t>(pool.NumThreads());
+  out.Gauge("scheduler_threads", "workers of the pool", workers);
+  out.Gauge("scheduler_active_threads", "workers taking part in scheduling",
+            pool.NumActiveThreads());
+  out.Family("scheduler_queue_depth", "gauge",
+             "tasks in the queue of a slot, runnext included");
+  for (size_t i = 0; i != load.size(); ++i) {
+    out.Sample("scheduler_queue_depth",
+               load[i].queue_size + load[i].runnext,
+               "slot=\"" + std::to_string(i) + "\"");
+  }
+  out.Gauge("scheduler_injected_queue_depth",
+            "tasks from outside of the pool waiting to be taken",
+            pool.InjectedSize());
+  size_t states[3] = {};
+  for (size_t i = 0; i != std::min(workers, load.size()); ++i) {
+    ++states[static_cast<size_t>(load[i].state)];
+  }
+  out.Family("scheduler_workers", "gauge", "workers by state");
+  out.Sample("scheduler_workers", states[0], "state=\"running\"");
+  out.Sample("scheduler_workers", states[1], "state=\"spinning\"");
+  out.Sample("scheduler_workers", states[2], "state=\"parked\"");
+
+  auto stats = pool.GetStats();
+  if (stats.empty()) {
+    return;
+  }
+  typename std::decay_t<decltype(stats.front())> total;
+  for (auto &slot : stats) {
+    total += slot;
+  }
+  out.Counter("scheduler_tasks", "tasks taken by all threads", total.Tasks());
+  out.Counter("scheduler_steals", "tasks taken from other slots",
+              total.steals);
+  out.Counter("scheduler_steal_attempts", "victims probed by thieves",
+              total.steal_attempts);
+  out.Counter("scheduler_idle_loops",
+              "worker loop iterations which found no task", total.idle_loops);
+}
+
+// Background thread serving metrics on a Unix socket. Pool metrics are
+// written by `source`, ParallelFor ones are collected here.
+class Reporter {
+public:
+  using Source = std::function<void(Exposition &)>;
+
+  Reporter(std::string path, size_t threads, Source source = {})
+      : Path_(std::move(path)), Source_(std::move(source)),
+        Stats_(threads) {
+    Fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (Fd_ < 0 || Path_.size() >= sizeof(addr.sun_path)) {
+      std::cerr << "metrics: can't serve on " << Path_ << "\n";
+      return;
+    }
+    Path_.copy(addr.sun_path, Path_.size());
+    unlink(Path_.c_str()); // left by a previous run
+    if (bind(Fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+        listen(Fd_, 4) != 0) {
+      std::cerr << "metrics: can't serve on " << Path_ << ": errno " << errno
+                << "\n";
+      return;
+    }
+    ParallelForStats::Active().store(&Stats_, std::memory_order_release);
+    Thread_ = std::thread([this] { Serve(); });
+  }
+
+  Reporter(const Reporter &) = delete;
+  Reporter &operator=(const Reporter &) = delete;
+
+  // ParallelFor calls must have returned
+  ~Reporter() {
+    auto *self = &Stats_;
+    ParallelForStats::Active().compare_exchange_strong(self, nullptr);
+    Stop_.store(true, std::memory_order_relaxed);
+    if (Thread_.joinable()) {
+      Thread_.join();
+      unlink(Path_.c_str());
+    }
+    if (Fd_ >= 0) {
+      close(Fd_);
+    }
+  }
+
+  // current metrics in the text format
+  std::string Render() {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    auto now = Now();
+    double interval = LastScrape_ ? CyclesToNs(now - LastScrape_) / 1e9 : 0;
+    LastScrape_ = now;
+    std::ostringstream text;
+    text.precision(15); // counters stay exact
+    Exposition out(text, Previous_, interval);
+    if (Source_) {
+      Source_(out);
+    }
+    auto latency = Stats_.Latency();
+    out.Counter("parallel_for_calls", "ParallelFor calls", latency->Count());
+    out.Family("parallel_for_latency_seconds", "summary",
+               "time from a ParallelFor call until it returned");
+    for (auto q : {0.5, 0.9, 0.99, 0.999}) {
+      std::ostringstream label;
+      label << "quantile=\"" << q << "\"";
+      out.Sample("parallel_for_latency_seconds",
+                 CyclesToNs(latency->Quantile(q)) / 1e9, label.str());
+    }
+    out.Sample("parallel_for_latency_seconds_sum",
+               CyclesToNs(Stats_.LatencySum()) / 1e9);
+    out.Sample("parallel_for_latency_seconds_count", latency->Count());
+    return text.str();
+  }
+
+private:
+  void Serve() {
+    while (!Stop_.load(std::memory_order_relaxed)) {
+      pollfd pfd{Fd_, POLLIN, 0};
+      if (poll(&pfd, 1, 100) <= 0) {
+        continue;
+      }
+      int client = accept4(Fd_, nullptr, nullptr, SOCK_CLOEXEC);
+      if (client < 0) {
+        continue;
+      }
+      // HTTP clients get a response, so curl works as well as socat
+      char request[512];
+      pollfd cpfd{client, POLLIN, 0};
+      ssize_t received = poll(&cpfd, 1, 10) > 0
+                             ? recv(client, request, sizeof(request), 0)
+                             : 0;
+      bool http = received >= 4 && std::string(request, 4) == "GET ";
+      auto body = Render();
+      std::string response;
+      if (http) {
+        response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; "
+                   "version=0.0.4\r\nContent-Length: " +
+                   std::to_string(body.size()) + "\r\n\r\n";
+      }
+      response += body;
+      for (size_t sent = 0; sent < response.size();) {
+        auto n = send(client, response.data() + sent, response.size() - sent,
+                      MSG_NOSIGNAL);
+        if (n <= 0) {
+          break;
+        }
+        sent += n;
+      }
+      close(client);
+    }
+  }
+
+  std::string Path_;
+  Source Source_;
+  ParallelForStats Stats_;
+  int Fd_ = -1;
+  std::atomic<bool> Stop_{false};
+  std::thread Thread_;
+  std::mutex Mutex_; // only scrapes take it
+  std::unordered_map<std::string, double> Previous_; // guarded by Mutex_
+  Timestamp LastScrape_ = 0;                         // guarded by Mutex_
+};
+
+} // namespace Metrics
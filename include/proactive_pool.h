@@ -0,0 +1,186 @@
+#pragma once
+#include "clock.h"
+#include "modes.h"
+#include "num_threads.h"
+
+#ifdef PROACTIVE_MODE
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Proactive {
+
+// Minimal push-based pool: no queues and no stealing. Each worker owns a
+// mailbox, caller splits the range statically, posts the parts straight into
+// the mailboxes and runs the first part itself (caller is thread 0).
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t threads)
+      : NumThreads_(std::max<size_t>(threads, 1)),
+        Mailboxes_(new Mailbox[NumThreads_]) {
+    for (size_t i = 1; i != NumThreads_; ++i) {
+      Workers_.emplace_back([this, i] { WorkerLoop(i); });
+    }
+  }
+
+  ~ThreadPool() {
+    Done_.store(true, std::memory_order_relaxed);
+    for (size_t i = 1; i != NumThreads_; ++i) {
+      Post(Mailboxes_[i], Generation_ + 1);
+    }
+    for (auto &worker : Workers_) {
+      worker.join();
+    }
+  }
+
+  size_t NumThreads() const { return NumThreads_; }
+
+  // 0 for main thread and other external threads
+  static int CurrentThreadId() { return ThreadId(); }
+
+  // Calls func(from, to) for a static split of [from, to) into parts of at
+  // least grainSize iterations, i'th part is run by i'th thread. Nested calls
+  // are run in place: workers can't be preempted by a new job. Calls from
+  // other external threads wait for the current one.
+  template <typename F>
+  void Run(size_t from, size_t to, F &&func, size_t grainSize = 1) {
+    if (from == to) {
+      return;
+    }
+    if (InRegion()) {
+      func(from, to);
+      return;
+    }
+    std::lock_guard<std::mutex> submitLock(Submit_);
+    InRegion() = true;
+    grainSize = std::max<size_t>(grainSize, 1);
+    auto parts = std::min(NumThreads_, (to - from + grainSize - 1) / grainSize);
+    Job job{&func, [](void *ctx, size_t from, size_t to) {
+              (*static_cast<std::remove_reference_t<F> *>(ctx))(from, to);
+            }};
+    auto generation = ++Generation_;
+    Pending_.store(parts - 1, std::memory_order_relaxed);
+    for (size_t i = 1; i != parts; ++i) {
+      auto &box = Mailboxes_[i];
+      box.Work = job;
+      std::tie(box.From, box.To) = Split(from, to, i, parts);
+      Post(box, generation);
+    }
+    auto [myFrom, myTo] = Split(from, to, 0, parts);
+    func(myFrom, myTo);
+    for (size_t spin = 0; Pending_.load(std::memory_order_acquire) != 0;
+         ++spin) {
+      if (spin < SPIN_COUNT) {
+        CpuRelax();
+      } else {
+        std::this_thread::yield();
+      }
+    }
+    InRegion() = false;
+  }
+
+private:
+  static constexpr size_t SPIN_COUNT = 1 << 14;
+
+  struct Job {
+    void *Ctx = nullptr;
+    void (*Call)(void *, size_t, size_t) = nullptr;
+  };
+
+  // padded to cache line, written by the caller and read by one worker
+  struct alignas(64) Mailbox {
+    std::atomic<uint64_t> Generation{0};
+    Job Work;
+    size_t From = 0;
+    size_t To = 0;
+    std::atomic<bool> Sleeping{false};
+    std::mutex Mutex;
+    std::condition_variable Cv;
+  };
+
+  static std::pair<size_t, size_t> Split(size_t from, size_t to, size_t part,
+                                         size_t parts) {
+    auto step = (to - from) / parts;
+    auto mod = (to - from) % parts;
+    auto begin = from + part * step + std::min(part, mod);
+    return {begin, begin + step + (part < mod)};
+  }
+
+  static int &ThreadId() {
+    static thread_local int id = 0;
+    return id;
+  }
+
+  static bool &InRegion() {
+    static thread_local bool inRegion = false;
+    return inRegion;
+  }
+
+  void Post(Mailbox &box, uint64_t generation) {
+    // seq_cst pairs with Sleeping/Generation in Wait, so either worker sees
+    // new generation or we see it sleeping
+    box.Generation.store(generation);
+    if (box.Sleeping.load()) {
+      std::lock_guard<std::mutex> lock(box.Mutex);
+      box.Cv.notify_one();
+    }
+  }
+
+  uint64_t Wait(Mailbox &box, uint64_t seen) {
+    for (size_t spin = 0; spin != SPIN_COUNT; ++spin) {
+      auto generation = box.Generation.load(std::memory_order_acquire);
+      if (generation != seen) {
+        return generation;
+      }
+      CpuRelax();
+    }
+    std::unique_lock<std::mutex> lock(box.Mutex);
+    box.Sleeping.store(true);
+    uint64_t generation;
+    box.Cv.wait(lock, [&] {
+      generation = box.Generation.load();
+      return generation != seen;
+    });
+    box.Sleeping.store(false, std::memory_order_relaxed);
+    return generation;
+  }
+
+  void WorkerLoop(size_t id) {
+    ThreadId() = static_cast<int>(id);
+    // workers never submit to their own pool
+    InRegion() = true;
+    auto &box = Mailboxes_[id];
+    uint64_t seen = 0;
+    while (true) {
+      seen = Wait(box, seen);
+      if (Done_.load(std::memory_order_relaxed)) {
+        return;
+      }
+      box.Work.Call(box.Work.Ctx, box.From, box.To);
+      Pending_.fetch_sub(1, std::memory_order_release);
+    }
+  }
+
+  const size_t NumThreads_;
+  std::unique_ptr<Mailbox[]> Mailboxes_;
+  std::vector<std::thread> Workers_;
+  std::mutex Submit_;
+  uint64_t Generation_ = 0; // guarded by Submit_
+  alignas(64) std::atomic<size_t> Pending_{0};
+  std::atomic<bool> Done_{false};
+};
+
+} // namespace Proactive
+
+inline Proactive::ThreadPool ProactivePool(GetNumThreads());
+
+#endif
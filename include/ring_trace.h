@@ -0,0 +1,133 @@
+#pragma once
+#include "parallel_for.h"
+#include "trace.h"
+#include "trace_buffer.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Tracing {
+
+// Tracer with a low probe effect: a task start and end are two 16 byte
+// stores into the thread's own preallocated buffer and a rdtsc each, no
+// allocations, shared writes or syscalls. Records are merged into
+// IterationResult after the run, so JSON is the same as Tracer's.
+// With SCHED_TRACE scheduler trace points write to the last created tracer.
+class RingTracer {
+public:
+  // capacity is in records per thread (two per task, two per iteration),
+  // buffers for `threads` threads are allocated here, others on first use
+  RingTracer(size_t threads, size_t capacity)
+      : Buffers_(threads, capacity, GetThreadIndex) {
+    Buffers_.Activate();
+  }
+
+  template <typename F> void RunIteration(size_t tasks, F &&f) {
+    Buffers_.Local().Write(Now(), tasks, EventKind::ITERATION_START);
+    ParallelFor(0, tasks, [&](size_t i) {
+      auto &buffer = Buffers_.Local();
+      uint16_t cpu;
+      auto start = NowOnCpu(cpu);
+      buffer.Write(start, i, EventKind::TASK_START, cpu);
+      f(i);
+      buffer.Write(Now(), i, EventKind::TASK_END);
+    });
+    Buffers_.Local().Write(Now(), 0, EventKind::ITERATION_END);
+  }
+
+  // records lost because some buffer was full
+  size_t Dropped() const { return Buffers_.Dropped(); }
+
+  // Iterations which are fully kept in buffers, call after the run.
+  std::vector<IterationResult> Merge() const {
+    struct Bounds {
+      Timestamp Start = 0;
+      Timestamp End = 0;
+      size_t Tasks = 0;
+    };
+    std::vector<Bounds> bounds;
+    Timestamp keptFrom = 0; // records before it may be lost
+    Buffers_.ForEach([&](size_t, const RingBuffer &buffer) {
+      auto own = bounds.size(); // iterations started by this thread
+      bool first = true;
+      buffer.ForEach([&](const Record &record) {
+        if (first && buffer.Dropped() != 0) {
+          keptFrom = std::max(keptFrom, record.Time);
+        }
+        first = false;
+        if (record.Kind == EventKind::ITERATION_START) {
+          bounds.push_back({record.Time, 0, record.Arg});
+        } else if (record.Kind == EventKind::ITERATION_END &&
+                   bounds.size() != own) {
+          bounds.back().End = record.Time;
+        }
+      });
+    });
+    std::sort(bounds.begin(), bounds.end(),
+              [](auto &lhs, auto &rhs) { return lhs.Start < rhs.Start; });
+    bounds.erase(std::remove_if(bounds.begin(), bounds.end(),
+                                [&](auto &iteration) {
+                                  return iteration.Start < keptFrom ||
+                                         iteration.End == 0;
+                                }),
+                 bounds.end());
+
+    std::vector<IterationResult> results;
+    for (auto &iteration : bounds) {
+      results.emplace_back(iteration.Tasks);
+      results.back().Start = iteration.Start;
+      results.back().End = iteration.End - iteration.Start;
+    }
+    Buffers_.ForEach([&](size_t, const RingBuffer &buffer) {
+      std::vector<Record> started; // nested tasks end before outer ones
+      Timestamp wroteTrace = 0;
+      buffer.ForEach([&](const Record &record) {
+        if (record.Kind == EventKind::TASK_START) {
+          started.push_back(record);
+          return;
+        }
+        if (record.Kind != EventKind::TASK_END || started.empty()) {
+          return;
+        }
+        auto start = started.back();
+        started.pop_back();
+        auto it = std::upper_bound(
+            bounds.begin(), bounds.end(), start.Time,
+            [](Timestamp time, auto &iteration) {
+              return time < iteration.Start;
+            });
+        if (it == bounds.begin() || (it - 1)->End < record.Time) {
+          return; // iteration is dropped
+        }
+        auto &result = results[it - 1 - bounds.begin()];
+        auto &task = result.Tasks[start.Arg];
+        task.TaskIdx = start.Arg;
+        task.ThreadIdx = buffer.Thread;
+        task.SchedCpu = start.Cpu == NO_CPU ? buffer.Cpu : start.Cpu;
+        task.Trace.IterationStart = result.Start;
+        task.Trace.PreviousTrace = wroteTrace;
+        task.Trace.ExecutionStart = start.Time - result.Start;
+        task.Trace.ExecutionEnd = record.Time - result.Start;
+        wroteTrace = task.Trace.ExecutionEnd;
+      });
+    });
+    return results;
+  }
+
+  std::string ToJson(size_t threadNum) const {
+    return Tracing::ToJson(Merge(), threadNum);
+  }
+
+  // func(index, buffer) for every used buffer, call after the run
+  template <typename F> void ForEachBuffer(F &&func) const {
+    Buffers_.ForEach(std::forward<F>(func));
+  }
+
+private:
+  TraceBuffers Buffers_;
+};
+
+} // namespace Tracing
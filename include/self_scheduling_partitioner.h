@@ -0,0 +1,178 @@
+#pragma once
+#include "chunk_schedule.h"
+#include "timespan_partitioner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Self-scheduling loops (as in LB4OMP): after a broadcast start all threads
+// claim decreasing chunks from a shared atomic counter.
+namespace EigenPartitioner {
+
+enum class ChunkPolicy {
+  GUIDED,    // each chunk is remaining / threads
+  FACTORING, // FAC2: batches of `threads` equal chunks, each batch takes half
+             // of the remaining iterations
+  ADAPTIVE_WEIGHTED, // AWF: FAC2 with chunks proportional to thread speed
+                     // learned from previous loops
+};
+
+// weights of EigenPool threads, shared by all adaptive loops
+inline ThreadWeights &PoolThreadWeights() {
+  static ThreadWeights weights(GetNumThreads());
+  return weights;
+}
+
+template <ChunkPolicy policy> struct SelfSchedulingLoop {
+  SelfSchedulingLoop(size_t total, size_t threads, size_t minChunk)
+      : Total(total), Threads(threads), MinChunk(minChunk) {
+    if constexpr (policy == ChunkPolicy::ADAPTIVE_WEIGHTED) {
+      // snapshot, so weights don't change during the loop
+      Weights.resize(threads);
+      for (size_t i = 0; i != threads; ++i) {
+        Weights[i] = PoolThreadWeights().Get(i);
+        WeightSum += Weights[i];
+      }
+      Stats.resize(threads);
+    }
+  }
+
+  // returns false when all iterations are claimed
+  bool Claim(Chunk &chunk, size_t slot) {
+    if constexpr (policy != ChunkPolicy::FACTORING) {
+      auto next = Next.load(std::memory_order_relaxed);
+      while (next < Total) {
+        size_t size;
+        if constexpr (policy == ChunkPolicy::GUIDED) {
+          size = GuidedChunkSize(next, Total, Threads, MinChunk);
+        } else {
+          auto weight = slot < Threads ? Weights[slot] : WeightSum / Threads;
+          size = WeightedChunkSize(next, Total, weight, WeightSum, MinChunk);
+        }
+        auto to = std::min(Total, next + size);
+        if (Next.compare_exchange_weak(next, to, std::memory_order_relaxed)) {
+          chunk = {next, to};
+          return true;
+        }
+      }
+      return false;
+    } else {
+      chunk = FactoringChunk(Next.fetch_add(1, std::memory_order_relaxed),
+                             Total, Threads, MinChunk);
+      return chunk.first != Total;
+    }
+  }
+
+  void OnExecuted(size_t slot, size_t iterations, Timestamp cycles) {
+    if (slot < Stats.size()) {
+      Stats[slot].Iterations += iterations;
+      Stats[slot].Cycles += cycles;
+    }
+  }
+
+  const size_t Total;
+  const size_t Threads;
+  const size_t MinChunk;
+  // only for ADAPTIVE_WEIGHTED
+  std::vector<double> Weights;
+  double WeightSum = 0;
+  std::vector<ThreadStat> Stats; // written only by thread of the slot
+  // next iteration, or next chunk index for factoring
+  alignas(hardware_destructive_interference_size) std::atomic<size_t> Next{0};
+};
+
+// Runs on threads [Threads.From, Threads.To): hands the upper half of the
+// range to its first thread (binary tree broadcast, like DistributeWork)
+// and then claims chunks until the loop is exhausted.
+template <typename Scheduler, typename Func, ChunkPolicy policy>
+struct SelfSchedulingTask {
+  void operator()() {
+    while (Threads.Size() > 1) {
+      size_t mid = Threads.From + (Threads.Size() + 1) / 2;
+      Sched.run_on_thread(
+          SelfSchedulingTask{Sched, new TaskNode(Node), Loop, From, Func_,
+                             Range{mid, Threads.To}},
+          mid);
+      Threads.To = mid;
+    }
+    Chunk chunk;
+    size_t slot = Sched.thread_index();
+    while (Loop->Claim(chunk, slot)) {
+      if constexpr (policy == ChunkPolicy::ADAPTIVE_WEIGHTED) {
+        // only AWF learns from chunk times
+        auto start = Now();
+        RunChunk(chunk);
+        Loop->OnExecuted(slot, chunk.second - chunk.first, Now() - start);
+      } else {
+        RunChunk(chunk);
+      }
+    }
+    Node.Reset();
+  }
+
+  void RunChunk(const Chunk &chunk) {
+    for (size_t i = From + chunk.first; i != From + chunk.second; ++i) {
+      Func_(i);
+    }
+  }
+
+  Scheduler &Sched;
+  IntrusivePtr<TaskNode> Node;
+  SelfSchedulingLoop<policy> *Loop;
+  size_t From;
+  Func Func_;
+  Range Threads;
+};
+
+template <typename Sched, ChunkPolicy policy, typename F>
+void ParallelForSelfScheduling(size_t from, size_t to, F func,
+                               size_t grainSize = 1) {
+  if (from == to) {
+    return;
+  }
+  Sched sched;
+  auto threads = std::min(sched.num_threads(), to - from);
+  SelfSchedulingLoop<policy> loop{to - from, threads,
+                                  std::max<size_t>(grainSize, 1)};
+  // tasks may still be queued after all chunks are claimed, the caller helps
+  // with them until all are finished, as in ParallelFor
+  TaskNode rootNode;
+  IntrusivePtrAddRef(&rootNode);
+  SelfSchedulingTask<Sched, F, policy>{sched,
+                                       IntrusivePtr<TaskNode>(&rootNode),
+                                       &loop,
+                                       from,
+                                       std::move(func),
+                                       Range{0, threads}}();
+  sched.join_main_thread([&] { return IntrusivePtrLoadRef(&rootNode) == 1; });
+  if constexpr (policy == ChunkPolicy::ADAPTIVE_WEIGHTED) {
+    PoolThreadWeights().Update(loop.Stats);
+  }
+}
+
+template <typename Sched, typename F>
+void ParallelForGuided(size_t from, size_t to, F func, size_t grainSize = 1) {
+  ParallelForSelfScheduling<Sched, ChunkPolicy::GUIDED>(
+      from, to, std::move(func), grainSize);
+}
+
+template <typename Sched, typename F>
+void ParallelForFactoring(size_t from, size_t to, F func,
+                          size_t grainSize = 1) {
+  ParallelForSelfScheduling<Sched, ChunkPolicy::FACTORING>(
+      from, to, std::move(func), grainSize);
+}
+
+template <typename Sched, typename F>
+void ParallelForAdaptiveWeighted(size_t from, size_t to, F func,
+                                 size_t grainSize = 1) {
+  ParallelForSelfScheduling<Sched, ChunkPolicy::ADAPTIVE_WEIGHTED>(
+      from, to, std::move(func), grainSize);
+}
+
+} // namespace EigenPartitioner
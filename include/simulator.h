@@ -0,0 +1,296 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <numeric>
+#include <optional>
+#include <queue>
+#include <random>
+#include <vector>
+
+// Discrete-event model of EigenPartitioner::Task on virtual threads of an
+// Eigen-like pool (runnext, LIFO own queue, FIFO steals). Iteration costs and
+// scheduler primitive costs are given, so makespan and start latency of a
+// ParallelFor can be predicted for other K_SPLIT, INIT_TIME or steal policy
+// without running it. All times are in Now() ticks, as in traces.
+namespace Simulator {
+
+enum class Balance { OFF, SIMPLE, DELAYED };
+
+enum class StealPolicy {
+  RANDOM,     // random victim order, as Eigen's Steal
+  NEIGHBOURS, // next threads first, from the thief's index
+};
+
+struct Costs {
+  double Push = 100;      // to put a task into a queue
+  double Wake = 1000;     // from run_on_thread until target may take the task
+  double Pop = 20;        // of own runnext or queue
+  double Steal = 300;     // successful steal scan
+  double StealFail = 200; // scan which found nothing, idle thread rescans
+};
+
+struct Config {
+  size_t Threads = 4;
+  Balance Mode = Balance::DELAYED;
+  StealPolicy Steal = StealPolicy::RANDOM;
+  size_t KSplit = 2;
+  double InitTime = 13500;
+  size_t GrainSize = 1;
+  Costs Cost;
+};
+
+struct Result {
+  double Makespan = 0;
+  // time of the first iteration of each thread, -1 if it had none
+  std::vector<double> StartLatency;
+  size_t Spawned = 0; // by distribution and balancing
+  size_t Steals = 0;
+};
+
+class Simulation {
+public:
+  Simulation(const Config &config, const std::vector<double> &costs,
+             uint64_t seed = 0)
+      : Config_(config), Costs_(costs), Threads_(config.Threads),
+        Random_(seed) {}
+
+  Result Run() {
+    Result result;
+    result.StartLatency.assign(Config_.Threads, -1);
+    if (Costs_.empty()) {
+      return result;
+    }
+    StartTask(0, Task{0, Costs_.size(), 0, Config_.Threads, 0, true,
+                      Config_.Mode});
+    for (size_t i = 0; i != Config_.Threads; ++i) {
+      Schedule(0, i);
+    }
+    size_t executed = 0;
+    while (executed != Costs_.size()) {
+      auto event = Events_.top();
+      Events_.pop();
+      Now_ = event.Time;
+      auto &thread = Threads_[event.Thread];
+      if (event.Delivery) {
+        if (!thread.Runnext) {
+          thread.Runnext = event.Delivery;
+        } else {
+          thread.Queue.push_back(*event.Delivery);
+        }
+        if (thread.Idle) {
+          // waiting thread is notified, its pending rescan is dropped
+          thread.Idle = false;
+          ++thread.Generation;
+          Schedule(Now_, event.Thread);
+        }
+        continue;
+      }
+      if (event.Generation != thread.Generation) {
+        continue;
+      }
+      if (!thread.Current) {
+        Schedule(Now_ + FindWork(event.Thread, result), event.Thread);
+        continue;
+      }
+      auto &task = *thread.Current;
+      double cost = 0;
+      switch (thread.State) {
+      case Phase::DISTRIBUTE: {
+        auto part = thread.Parts.front();
+        thread.Parts.pop_front();
+        cost = Config_.Cost.Push;
+        Deliver(Now_ + cost + Config_.Cost.Wake, part.ThreadsFrom, part);
+        ++result.Spawned;
+        if (thread.Parts.empty()) {
+          thread.State = FirstPhase(task);
+          thread.InitStart = Now_ + cost;
+        }
+        break;
+      }
+      case Phase::BALANCE:
+        if (IsDivisible(task)) {
+          size_t mid = task.From + (task.To - task.From) / 2;
+          thread.Queue.push_front(Task{mid, task.To, 0, 0, task.Depth + 1,
+                                       false, Balance::SIMPLE});
+          task.To = mid;
+          cost = Config_.Cost.Push;
+          ++result.Spawned;
+        } else {
+          thread.State = Phase::EXECUTE;
+        }
+        break;
+      case Phase::INIT:
+      case Phase::EXECUTE:
+        if (result.StartLatency[event.Thread] < 0) {
+          result.StartLatency[event.Thread] = Now_;
+        }
+        cost = Costs_[task.From++];
+        ++executed;
+        result.Makespan = std::max(result.Makespan, Now_ + cost);
+        if (thread.State == Phase::INIT &&
+            Now_ + cost - thread.InitStart > Config_.InitTime) {
+          thread.State = Phase::BALANCE;
+        }
+        break;
+      }
+      if (task.From == task.To && thread.State != Phase::DISTRIBUTE) {
+        thread.Current.reset();
+      }
+      Schedule(Now_ + cost, event.Thread);
+    }
+    return result;
+  }
+
+private:
+  struct Task {
+    size_t From;
+    size_t To;
+    size_t ThreadsFrom; // only for initial tasks
+    size_t ThreadsTo;
+    size_t Depth;
+    bool Initial;
+    Balance Mode;
+  };
+
+  enum class Phase { DISTRIBUTE, INIT, BALANCE, EXECUTE };
+
+  struct Thread {
+    std::optional<Task> Runnext;
+    std::deque<Task> Queue; // owner uses front, thieves take back
+    std::optional<Task> Current;
+    Phase State = Phase::EXECUTE;
+    std::deque<Task> Parts; // left to distribute
+    double InitStart = 0;
+    bool Idle = false;       // last scan found nothing
+    uint64_t Generation = 0; // of the resume event which is still valid
+  };
+
+  struct Event {
+    double Time;
+    uint64_t Order; // events of the same time are in order of scheduling
+    size_t Thread;
+    uint64_t Generation;
+    std::optional<Task> Delivery; // resume of the thread if empty
+
+    bool operator>(const Event &other) const {
+      return Time != other.Time ? Time > other.Time : Order > other.Order;
+    }
+  };
+
+  bool IsDivisible(const Task &task) const {
+    return task.From + Config_.GrainSize < task.To;
+  }
+
+  Phase FirstPhase(const Task &task) const {
+    switch (task.Mode) {
+    case Balance::DELAYED:
+      return Phase::INIT;
+    case Balance::SIMPLE:
+      return Phase::BALANCE;
+    default:
+      return Phase::EXECUTE;
+    }
+  }
+
+  // as Task::DistributeWork: own share is kept, the rest is split into
+  // KSplit parts for the first threads of the thread subranges
+  void StartTask(size_t id, Task task) {
+    auto &thread = Threads_[id];
+    thread.Parts.clear();
+    size_t threads = task.ThreadsTo - task.ThreadsFrom;
+    if (task.Initial && threads > 1 && IsDivisible(task)) {
+      size_t otherFrom = task.From + (task.To - task.From + threads - 1) /
+                                         threads;
+      size_t otherTo = task.To;
+      if (otherFrom < otherTo) {
+        task.To = otherFrom;
+        size_t threadsFrom = task.ThreadsFrom + 1;
+        size_t otherThreads = task.ThreadsTo - threadsFrom;
+        size_t parts = std::min(std::min(Config_.KSplit, otherThreads),
+                                otherTo - otherFrom);
+        auto threadStep = otherThreads / parts;
+        auto threadsMod = otherThreads % parts;
+        auto dataStep = (otherTo - otherFrom) / parts;
+        auto dataMod = (otherTo - otherFrom) % parts;
+        for (size_t i = 0; i != parts; ++i) {
+          auto threadSplit = std::min(
+              task.ThreadsTo,
+              threadsFrom + threadStep + ((parts - 1 - i) < threadsMod));
+          auto dataSplit = std::min(
+              otherTo,
+              otherFrom + dataStep +
+                  ((threadsMod == 0 ? i : (parts - 1 - i)) < dataMod));
+          thread.Parts.push_back(Task{otherFrom, dataSplit, threadsFrom,
+                                      threadSplit, 0, true, task.Mode});
+          threadsFrom = threadSplit;
+          otherFrom = dataSplit;
+        }
+      }
+    }
+    thread.State = thread.Parts.empty() ? FirstPhase(task) : Phase::DISTRIBUTE;
+    thread.InitStart = Now_;
+    thread.Current = task;
+  }
+
+  // returns time spent, starts the found task
+  double FindWork(size_t id, Result &result) {
+    auto &thread = Threads_[id];
+    thread.Idle = false;
+    if (thread.Runnext || !thread.Queue.empty()) {
+      Task task;
+      if (thread.Runnext) {
+        task = *thread.Runnext;
+        thread.Runnext.reset();
+      } else {
+        task = thread.Queue.front();
+        thread.Queue.pop_front();
+      }
+      StartTask(id, task);
+      return Config_.Cost.Pop;
+    }
+    size_t count = Threads_.size();
+    size_t start = id + 1;
+    size_t step = 1;
+    if (Config_.Steal == StealPolicy::RANDOM) {
+      // coprime step visits all victims, as Eigen's Steal does
+      start = Random_() % count;
+      do {
+        step = Random_() % count + 1;
+      } while (std::gcd(step, count) != 1);
+    }
+    for (size_t i = 0; i != count; ++i) {
+      auto victim = (start + i * step) % count;
+      auto &queue = Threads_[victim].Queue;
+      if (victim != id && !queue.empty()) {
+        auto task = queue.back();
+        queue.pop_back();
+        ++result.Steals;
+        StartTask(id, task);
+        return Config_.Cost.Steal;
+      }
+    }
+    thread.Idle = true;
+    return Config_.Cost.StealFail;
+  }
+
+  void Schedule(double time, size_t thread) {
+    Events_.push(
+        Event{time, Order_++, thread, Threads_[thread].Generation, std::nullopt});
+  }
+
+  void Deliver(double time, size_t thread, const Task &task) {
+    Events_.push(Event{time, Order_++, thread, 0, task});
+  }
+
+  const Config Config_;
+  const std::vector<double> &Costs_;
+  std::vector<Thread> Threads_;
+  std::mt19937_64 Random_;
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event>> Events_;
+  uint64_t Order_ = 0;
+  double Now_ = 0;
+};
+
+} // namespace Simulator
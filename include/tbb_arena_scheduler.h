@@ -0,0 +1,126 @@
+#pragma once
+#include "modes.h"
+#include "num_threads.h"
+#include "spin_lock.h"
+#include "util.h"
+
+#ifdef TBB_MODE
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <tbb/task_arena.h>
+#include <tbb/task_group.h>
+#include <type_traits>
+#include <utility>
+
+// Arena for TbbArenaScheduler, slot 0 is reserved for the main thread, so
+// thread indices inside it match ones timespan partitioner splits over.
+inline tbb::task_arena TbbArena(GetNumThreads(), 1);
+
+// Scheduler for EigenPartitioner on top of TBB workers (see EigenPoolWrapper).
+// One instance lives for one ParallelFor and must be created inside TbbArena.
+//
+// TBB has no way to spawn a task to a given thread, so run_on_thread uses
+// mailboxes, as affinity_partitioner does: task is put to the mailbox of
+// the hinted slot and a proxy is spawned. Proxy runs one task from the
+// mailbox of the thread which took it, or from the hinted mailbox if own one
+// is empty, so the number of tasks always matches the number of proxies.
+class TbbArenaScheduler {
+public:
+  TbbArenaScheduler()
+      : Slots_(TbbArena.max_concurrency()), Mailboxes_(new Mailbox[Slots_]) {}
+
+  template <typename F> void run(F &&f) {
+    Group_.run(MutableTask<std::decay_t<F>>{std::forward<F>(f)});
+  }
+
+  template <typename F> void run_on_thread(F &&f, size_t hint) {
+    hint %= Slots_;
+    Mailboxes_[hint].Push(new MailTask<std::decay_t<F>>(std::forward<F>(f)));
+    Group_.run([this, hint] { RunMail(hint); });
+  }
+
+  // task_group waits for all tasks, done() is checked for the concept's sake
+  template <typename Done> void join_main_thread(Done &&done) {
+    Group_.wait();
+    while (!done()) {
+      CpuRelax();
+    }
+  }
+
+  size_t num_threads() { return Slots_; }
+
+  // slot of the calling thread in TbbArena, -1 outside of it
+  int thread_index() {
+    return tbb::this_task_arena::current_thread_index();
+  }
+
+private:
+  // task_group runs functors as const, but partitioner's tasks aren't
+  template <typename F> struct MutableTask {
+    void operator()() const { Func(); }
+
+    mutable F Func;
+  };
+
+  struct MailTaskBase {
+    virtual ~MailTaskBase() = default;
+    virtual void Run() = 0;
+
+    MailTaskBase *Next = nullptr;
+  };
+
+  template <typename F> struct MailTask : MailTaskBase {
+    template <typename G> explicit MailTask(G &&f) : Func(std::forward<G>(f)) {}
+
+    void Run() override { Func(); }
+
+    F Func;
+  };
+
+  struct alignas(hardware_destructive_interference_size) Mailbox {
+    void Push(MailTaskBase *task) {
+      std::lock_guard<SpinLock> lock(Lock);
+      if (Tail) {
+        Tail->Next = task;
+      } else {
+        Head = task;
+      }
+      Tail = task;
+    }
+
+    MailTaskBase *Pop() {
+      std::lock_guard<SpinLock> lock(Lock);
+      auto *task = Head;
+      if (task) {
+        Head = task->Next;
+        if (!Head) {
+          Tail = nullptr;
+        }
+      }
+      return task;
+    }
+
+    SpinLock Lock;
+    MailTaskBase *Head = nullptr;
+    MailTaskBase *Tail = nullptr;
+  };
+
+  void RunMail(size_t hint) {
+    size_t slot = thread_index();
+    std::unique_ptr<MailTaskBase> task{slot < Slots_ ? Mailboxes_[slot].Pop()
+                                                     : nullptr};
+    // task for our proxy is in some mailbox already, but it may be taken
+    // by other proxy after we've checked, so keep looking
+    for (size_t i = 0; !task; ++i) {
+      task.reset(Mailboxes_[(hint + i) % Slots_].Pop());
+    }
+    task->Run();
+  }
+
+  size_t Slots_;
+  std::unique_ptr<Mailbox[]> Mailboxes_;
+  tbb::task_group Group_;
+};
+
+#endif
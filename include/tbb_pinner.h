@@ -1,5 +1,6 @@
 #pragma once
 
+#include "thread_budget.h"
 #include "util.h"
 #include <iostream>
 #include <sched.h>
@@ -7,11 +8,24 @@
 
 class PinningObserver : public tbb::task_scheduler_observer {
 public:
-  PinningObserver() { observe(true); }
+  // if lease is given, threads are pinned to leased cpus instead of the
+  // allowed ones
+  PinningObserver(const ThreadBudget::LeasedCpus *lease = nullptr)
+      : Lease_(lease) {
+    observe(true);
+  }
 
   void on_scheduler_entry(bool is_worker) {
-    PinThread(tbb::this_task_arena::current_thread_index());
+    auto slot = tbb::this_task_arena::current_thread_index();
+    if (!Lease_) {
+      PinThread(slot);
+    } else if (auto cpu = Lease_->CpuForSlot(slot); cpu >= 0) {
+      PinThreadToCpu(cpu);
+    }
   }
 
   ~PinningObserver() { observe(false); }
+
+private:
+  const ThreadBudget::LeasedCpus *Lease_;
 };
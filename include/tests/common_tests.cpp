@@ -0,0 +1,211 @@
+#include "../chunk_schedule.h"
+#include "../clock.h"
+#include "../eigen/injection_queue.h"
+#include "../histogram.h"
+#include "../simulator.h"
+#include "../thread_budget.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+// Tests of code which doesn't depend on the runtime, built once.
+
+TEST(Clock, Calibration) {
+  EXPECT_GT(TicksPerNs(), 0);
+  auto start = Now();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  auto ns = CyclesToNs(Now() - start);
+  EXPECT_GE(ns, 20'000'000);
+  EXPECT_LT(ns, 1'000'000'000);
+  EXPECT_NEAR(1e6, CyclesToNs(NsToCycles(1e6)), 1);
+}
+
+TEST(Histogram, Quantiles) {
+  for (uint64_t value : {uint64_t(0), uint64_t(1), uint64_t(127),
+                         uint64_t(128), uint64_t(1000), uint64_t(123456789),
+                         UINT64_MAX}) {
+    auto index = Histogram::Index(value);
+    EXPECT_LT(index, Histogram::BUCKETS);
+    EXPECT_GE(Histogram::HighestEquivalent(index), value);
+    EXPECT_LE(Histogram::HighestEquivalent(index) - value, value / 64);
+  }
+  HistogramSet set(2);
+  for (uint64_t i = 1; i <= 10000; ++i) {
+    set.Record(i % 3, i); // slot 2 is shared
+  }
+  auto merged = set.Merged();
+  EXPECT_EQ(10000, merged->Count());
+  EXPECT_EQ(1, merged->Min());
+  EXPECT_EQ(10000, merged->Max());
+  EXPECT_NEAR(5000, merged->Quantile(0.5), 5000 / 64);
+  EXPECT_NEAR(9900, merged->Quantile(0.99), 9900 / 64);
+  EXPECT_EQ(10000, merged->Quantile(1));
+}
+
+TEST(Simulator, Makespan) {
+  Simulator::Config config;
+  config.Threads = 8;
+  config.Cost = Simulator::Costs{0, 0, 0, 0, 0};
+  // free scheduling: every thread starts at once with its own iteration
+  config.Mode = Simulator::Balance::OFF;
+  std::vector<double> costs{1, 2, 3, 4, 5, 6, 7, 8};
+  auto result = Simulator::Simulation(config, costs).Run();
+  EXPECT_EQ(8, result.Makespan);
+  EXPECT_EQ(7, result.Spawned);
+  EXPECT_EQ(0, result.Steals);
+  for (auto latency : result.StartLatency) {
+    EXPECT_EQ(0, latency);
+  }
+
+  // one slow iteration, others are stolen from balancing tasks
+  config.Mode = Simulator::Balance::SIMPLE;
+  config.Cost = Simulator::Costs{};
+  costs.assign(1024, 100);
+  costs[0] = 1e6;
+  result = Simulator::Simulation(config, costs).Run();
+  EXPECT_GE(result.Makespan, 1e6);
+  EXPECT_LT(result.Makespan, 1e6 + 1024 * 100 / 7 + 20000);
+  EXPECT_GT(result.Steals, 0);
+}
+
+TEST(SelfScheduling, FactoringChunks) {
+  for (size_t total : {1, 7, 100, 1000, 12345}) {
+    for (size_t threads : {1, 3, 4, 48}) {
+      size_t expected = 0;
+      size_t prevSize = total;
+      for (size_t k = 0;; ++k) {
+        auto [from, to] =
+            EigenPartitioner::FactoringChunk(k, total, threads);
+        if (from == total) {
+          break;
+        }
+        EXPECT_EQ(expected, from);
+        EXPECT_LE(to - from, prevSize);
+        prevSize = to - from;
+        expected = to;
+      }
+      EXPECT_EQ(total, expected);
+    }
+  }
+}
+
+TEST(SelfScheduling, GuidedChunks) {
+  EXPECT_EQ(25, EigenPartitioner::GuidedChunkSize(0, 100, 4));
+  EXPECT_EQ(19, EigenPartitioner::GuidedChunkSize(25, 100, 4));
+  EXPECT_EQ(1, EigenPartitioner::GuidedChunkSize(99, 100, 4));
+  EXPECT_EQ(8, EigenPartitioner::GuidedChunkSize(99, 100, 4, 8));
+}
+
+TEST(SelfScheduling, AdaptiveWeights) {
+  EigenPartitioner::ThreadWeights weights(3);
+  // thread 0 is twice as fast, thread 2 took no chunks
+  std::vector<EigenPartitioner::ThreadStat> stats(3);
+  stats[0] = {200, 100};
+  stats[1] = {100, 100};
+  for (size_t i = 0; i != 20; ++i) {
+    weights.Update(stats);
+  }
+  EXPECT_NEAR(4.0 / 3, weights.Get(0), 1e-3);
+  EXPECT_NEAR(2.0 / 3, weights.Get(1), 1e-3);
+  EXPECT_EQ(1.0, weights.Get(2));
+  EXPECT_EQ(1.0, weights.Get(3));
+  // faster thread gets bigger share of the remaining iterations
+  EXPECT_GT(EigenPartitioner::WeightedChunkSize(0, 1000, weights.Get(0), 2),
+            EigenPartitioner::WeightedChunkSize(0, 1000, weights.Get(1), 2));
+}
+
+TEST(InjectionQueue, Batches) {
+  Eigen::InjectionQueue<int, 4> queue;
+  int out[4];
+  EXPECT_EQ(0, queue.PopBatch(out, 4));
+  for (int round = 0; round != 3; ++round) {
+    for (int i = 0; i != 4; ++i) {
+      EXPECT_TRUE(queue.Push(i));
+    }
+    EXPECT_FALSE(queue.Push(4));
+    EXPECT_EQ(3, queue.PopBatch(out, 3));
+    EXPECT_EQ(2, out[2]);
+    EXPECT_EQ(1, queue.PopBatch(out, 4));
+    EXPECT_EQ(3, out[0]);
+    EXPECT_TRUE(queue.Empty());
+  }
+}
+
+namespace {
+struct RecordingClient : ThreadBudget::Client {
+  void OnLease(const ThreadBudget::Lease &lease) override {
+    Last = lease;
+    ++Calls;
+  }
+
+  void OnUnmanaged() override { ++Unmanaged; }
+
+  ThreadBudget::Lease Last;
+  size_t Calls = 0;
+  size_t Unmanaged = 0;
+};
+} // namespace
+
+TEST(ThreadBudget, SingleClientGetsRequested) {
+  ThreadBudget::Manager manager(GetAllowedCpus().size());
+  RecordingClient client;
+  auto lease = manager.Acquire(&client, manager.TotalCpus());
+  EXPECT_EQ(manager.TotalCpus(), lease.size());
+  EXPECT_EQ(lease, client.Last);
+  lease = manager.Acquire(&client, 1);
+  EXPECT_EQ(1, lease.size());
+  EXPECT_EQ(lease, client.Last);
+}
+
+TEST(ThreadBudget, FairShareIsDisjoint) {
+  ThreadBudget::Manager manager(GetAllowedCpus().size());
+  auto total = manager.TotalCpus();
+  RecordingClient first, second;
+  manager.Acquire(&first, total);
+  EXPECT_EQ(total, first.Last.size());
+  manager.Acquire(&second, total);
+  if (total >= 2) {
+    // first one was asked to yield
+    EXPECT_EQ(2, first.Calls);
+    EXPECT_EQ(total, first.Last.size() + second.Last.size());
+    for (int cpu : first.Last) {
+      EXPECT_EQ(second.Last.end(),
+                std::find(second.Last.begin(), second.Last.end(), cpu));
+    }
+  }
+  manager.Release(&second);
+  EXPECT_EQ(total, first.Last.size());
+}
+
+TEST(ThreadBudget, ReleasedClientIsUnmanaged) {
+  ThreadBudget::Manager manager(GetAllowedCpus().size());
+  auto total = manager.TotalCpus();
+  RecordingClient first, second;
+  manager.Acquire(&first, total);
+  manager.Acquire(&second, total);
+  auto lease = second.Last;
+  auto calls = second.Calls;
+  manager.Release(&second);
+  // no new lease, only the release notification
+  EXPECT_EQ(calls, second.Calls);
+  EXPECT_EQ(lease, second.Last);
+  EXPECT_EQ(1, second.Unmanaged);
+  EXPECT_EQ(0, first.Unmanaged);
+  manager.Release(&first);
+  EXPECT_EQ(1, first.Unmanaged);
+  manager.Release(&first);
+  EXPECT_EQ(1, first.Unmanaged);
+}
+
+TEST(ThreadBudget, SmallRequestIsNotCut) {
+  ThreadBudget::Manager manager(GetAllowedCpus().size());
+  auto total = manager.TotalCpus();
+  RecordingClient small, big;
+  manager.Acquire(&big, total);
+  manager.Acquire(&small, 1);
+  EXPECT_EQ(1, small.Last.size());
+  EXPECT_EQ(std::max<size_t>(total - 1, 1), big.Last.size());
+}
@@ -1,8 +1,11 @@
 
 #include "../parallel_for.h"
+#include "../ring_trace.h"
 #include <atomic>
 #include <gtest/gtest.h>
+#include <memory>
 #include <random>
+#include <thread>
 
 TEST(ParallelFor, Basic) {
   std::atomic<int> sum(0);
@@ -108,7 +111,44 @@ TEST(ParallelFor, Workstealing) {
 }
 #endif
 
-#if defined(EIGEN_MODE)
+#if OMP_MODE == OMP_STATIC
+TEST(ParallelFor, StaticSplit) {
+  auto maxThreads = GetNumThreads();
+  auto count = [&](size_t tasks, size_t grainSize) {
+    std::vector<std::atomic<size_t>> perThread(maxThreads);
+    ParallelFor(
+        0, tasks, [&](size_t) { ++perThread[GetThreadIndex()]; }, grainSize);
+    std::vector<size_t> result;
+    for (auto &c : perThread) {
+      result.push_back(c.load());
+    }
+    return result;
+  };
+  // even split: no thread is left without work
+  auto tasks = 2 * maxThreads - 2;
+  for (auto c : count(tasks, 1)) {
+    EXPECT_GE(c, tasks / maxThreads);
+    EXPECT_LE(c, (tasks + maxThreads - 1) / maxThreads);
+  }
+  if (maxThreads > 1) {
+    // grain bigger than the even share: whole blocks of grainSize
+    auto blocks = count(2 * maxThreads, 4);
+    EXPECT_EQ(4, blocks[0]);
+    EXPECT_EQ(0, blocks[maxThreads - 1]);
+  }
+}
+#endif
+
+// self-scheduling modes hand out chunks in order of claiming
+#if (defined(EIGEN_MODE) && EIGEN_MODE != EIGEN_GUIDED &&                      \
+     EIGEN_MODE != EIGEN_FACTORING && EIGEN_MODE != EIGEN_AWF) ||              \
+    defined(PROACTIVE_MODE)
+#define STATIC_INITIAL_DISTRIBUTION 1
+#else
+#define STATIC_INITIAL_DISTRIBUTION 0
+#endif
+
+#if STATIC_INITIAL_DISTRIBUTION
 TEST(ParallelFor, InitialDistribution) {
   // all tasks should be distributed without work stealing
   auto maxThreads = GetNumThreads();
@@ -138,3 +178,242 @@ TEST(ParallelFor, InitialDistributionBalanced) {
   EXPECT_EQ(0, GetThreadIndex());
 }
 #endif
+
+#if defined(EIGEN_MODE) && EIGEN_MODE != EIGEN_RAPID
+TEST(ParallelFor, SetActiveThreads) {
+  auto maxThreads = GetNumThreads();
+  auto activeThreads = std::max(1, maxThreads / 2);
+  EigenPool.SetActiveThreads(activeThreads);
+  EXPECT_EQ(activeThreads, EigenPool.NumActiveThreads());
+  std::atomic<int> sum(0);
+  ParallelFor(0, 1000, [&](int i) {
+    EXPECT_LT(GetThreadIndex(), activeThreads);
+    sum++;
+  });
+  EXPECT_EQ(1000, sum);
+
+  // parked workers should be back after growing
+  EigenPool.SetActiveThreads(maxThreads);
+  SpinBarrier barrier(maxThreads);
+  ParallelFor(0, maxThreads, [&](int i) {
+#if STATIC_INITIAL_DISTRIBUTION
+    EXPECT_EQ(i, GetThreadIndex());
+#endif
+    barrier.Notify();
+    barrier.Wait();
+  });
+}
+#endif
+
+#if defined(EIGEN_MODE) && EIGEN_MODE != EIGEN_RAPID
+TEST(ParallelFor, BlockingRegion) {
+  // task queued to a blocked worker should be run by spare or thieves, even
+  // with a single thread; second run checks that spare comes back
+  for (int run = 0; run != 2; ++run) {
+    std::atomic<bool> done(false);
+    ParallelFor(0, 1, [&](int) {
+      BlockingRegion region;
+      EigenPool.RunOnThread(Eigen::MakeTask([&] { done = true; }),
+                            GetThreadIndex());
+      while (!done) {
+        std::this_thread::yield();
+      }
+    });
+  }
+}
+
+TEST(ParallelFor, BlockingTeardown) {
+  // pool is destroyed while a spare serves a blocked worker
+  std::atomic<bool> entered(false);
+  {
+    Eigen::ThreadPool pool(2);
+    pool.RunOnThread(Eigen::MakeTask([&] {
+                       bool blocking = pool.EnterBlocking();
+                       entered = true;
+                       std::this_thread::sleep_for(
+                           std::chrono::milliseconds(20));
+                       if (blocking) {
+                         pool.LeaveBlocking();
+                       }
+                     }),
+                     1);
+    while (!entered) {
+      std::this_thread::yield();
+    }
+  }
+  EXPECT_TRUE(entered);
+}
+
+// main thread is thread 0 of both pools
+inline Eigen::ThreadPool SecondPool(2, true, true);
+
+TEST(ParallelFor, IsolatedPools) {
+  std::atomic<int> sum(0);
+  EigenPartitioner::ParallelForSimple<EigenArenaWrapper<SecondPool>>(
+      0, 100, [&](size_t) {
+        auto id = SecondPool.CurrentThreadId();
+        EXPECT_TRUE(id == 0 || id == 1);
+        if (id == 1) {
+          // worker of one pool is external for others
+          EXPECT_EQ(-1, EigenPool.CurrentThreadId());
+        }
+        ParallelFor(0, 10, [&](int j) { sum += j; });
+      });
+  EXPECT_EQ(100 * 45, sum);
+  EXPECT_EQ(0, SecondPool.CurrentThreadId());
+  EXPECT_EQ(0, EigenPool.CurrentThreadId());
+}
+
+TEST(ParallelFor, JoinStealsLateTasks) {
+  // the worker spawns a task when the caller has nothing to do already and
+  // waits until someone else takes it: only the joined caller can
+  std::atomic<bool> started(false);
+  std::atomic<bool> taken(false);
+  std::atomic<bool> finished(false);
+  int takenBy = -1;
+  SecondPool.RunOnThread(
+      Eigen::MakeTask([&] {
+        started = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        SecondPool.Schedule(Eigen::MakeTask([&] {
+          takenBy = SecondPool.CurrentThreadId();
+          taken = true;
+        }));
+        auto deadline =
+            std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!taken && std::chrono::steady_clock::now() < deadline) {
+          std::this_thread::yield();
+        }
+        finished = true;
+      }),
+      1);
+  while (!started) {
+    std::this_thread::yield();
+  }
+  SecondPool.JoinMainThread([&] { return finished.load(); });
+  EXPECT_TRUE(taken);
+  EXPECT_EQ(0, takenBy);
+}
+
+TEST(ParallelFor, RecycledPoolIndex) {
+  // this thread is thread 0 of the first pool, which is destroyed by another
+  // thread, the next pool gets its index and address
+  alignas(Eigen::ThreadPool) static char storage[sizeof(Eigen::ThreadPool)];
+  auto *pool = new (storage) Eigen::ThreadPool(1, true, true);
+  Eigen::ThreadPool *next = nullptr;
+  std::thread([&] {
+    std::destroy_at(pool);
+    next = new (storage) Eigen::ThreadPool(1, true, true);
+    EXPECT_EQ(0, next->CurrentThreadId());
+  }).join();
+  EXPECT_EQ(-1, next->CurrentThreadId());
+  std::destroy_at(next);
+}
+
+TEST(ParallelFor, ExternalSlot) {
+  std::thread external([] {
+    auto caller = std::this_thread::get_id();
+    std::atomic<int> callerIndex(-1);
+    std::atomic<int> sum(0);
+    ParallelFor(0, 1000, [&](int i) {
+      if (std::this_thread::get_id() == caller) {
+        callerIndex = GetThreadIndex();
+      }
+      sum += i;
+    });
+    EXPECT_EQ(499500, sum);
+    // caller leases a slot after pool workers and returns it after the loop
+    EXPECT_GE(callerIndex, EigenPool.NumThreads());
+    EXPECT_EQ(-1, GetThreadIndex());
+  });
+  external.join();
+}
+
+TEST(ParallelFor, ExecutionReport) {
+  std::atomic<int> sum(0);
+  EigenPartitioner::ExecutionReport report;
+  EigenPartitioner::ParallelForStatic<EigenPoolWrapper>(
+      0, 1000, [&](int i) { sum += i; }, 1, &report);
+  EXPECT_EQ(499500, sum);
+  auto threads = GetNumThreads();
+  EXPECT_EQ(threads - 1, report.DistributedTasks);
+  EXPECT_EQ(0, report.BalancingTasks);
+  EXPECT_EQ(0, report.MaxDepth);
+  ASSERT_EQ(threads + 1, report.BusyCycles.size());
+  EXPECT_GT(report.BusyCycles[0], 0);
+  EXPECT_GE(report.Imbalance(), 1);
+}
+
+#ifdef SCHED_TRACE
+TEST(ParallelFor, TraceSpansAreBalanced) {
+  Tracing::RingTracer tracer(GetNumThreads(), 1 << 16);
+  for (int i = 0; i != 20; ++i) {
+    tracer.RunIteration(GetNumThreads() * 4, [](size_t) {});
+  }
+  ASSERT_EQ(0, tracer.Dropped());
+  using Tracing::EventKind;
+  tracer.ForEachBuffer([](size_t, const Tracing::RingBuffer &buffer) {
+    std::vector<EventKind> started;
+    bool caller = false;
+    bool first = true;
+    buffer.ForEach([&](const Tracing::Record &record) {
+      // worker may be idle since before the tracer was created
+      bool idleBefore = first && record.Kind == EventKind::IDLE_END;
+      first = false;
+      switch (record.Kind) {
+      case EventKind::ITERATION_START:
+        caller = true;
+        [[fallthrough]];
+      case EventKind::TASK_START:
+      case EventKind::IDLE_START:
+        started.push_back(record.Kind);
+        break;
+      case EventKind::ITERATION_END:
+      case EventKind::TASK_END:
+      case EventKind::IDLE_END:
+        if (idleBefore) {
+          break;
+        }
+        // ends are right after their starts in the enum
+        ASSERT_FALSE(started.empty());
+        EXPECT_EQ(static_cast<int>(started.back()) + 1,
+                  static_cast<int>(record.Kind));
+        started.pop_back();
+        break;
+      default:
+        break;
+      }
+    });
+    // workers may still be waiting, caller has returned
+    EXPECT_LE(started.size(), caller ? 0u : 1u);
+  });
+}
+#endif
+
+TEST(Metrics, Reporter) {
+  auto path = "/tmp/parallel_for_tests_" + std::to_string(getpid()) + ".sock";
+  Metrics::Reporter reporter(path, GetNumThreads(),
+                             [](Metrics::Exposition &out) {
+                               Metrics::WritePoolMetrics(EigenPool, out);
+                             });
+  for (size_t i = 0; i != 10; ++i) {
+    ParallelFor(0, 100, [](size_t) {});
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  path.copy(addr.sun_path, path.size());
+  ASSERT_EQ(0, connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)));
+  std::string text;
+  char buffer[4096];
+  for (ssize_t n; (n = read(fd, buffer, sizeof(buffer))) > 0;) {
+    text.append(buffer, n);
+  }
+  close(fd);
+  EXPECT_NE(std::string::npos, text.find("\nparallel_for_calls_total 10\n"));
+  EXPECT_NE(std::string::npos,
+            text.find("parallel_for_latency_seconds_count 10\n"));
+  EXPECT_NE(std::string::npos, text.find("scheduler_queue_depth{slot=\"0\"}"));
+  EXPECT_NE(std::string::npos, text.find("scheduler_workers{state=\"parked\"} 0"));
+}
+#endif
@@ -0,0 +1,203 @@
+#pragma once
+#include "available_cpus.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Process-wide cpu budget shared between thread pools of different runtimes.
+// Each pool registers a Client and asks for a number of threads, manager
+// splits available cpus between clients (fair share, nobody gets more than
+// requested) and hands out disjoint sets of cpus - leases. When a new client
+// comes, others are asked to yield cpus via Client::OnLease.
+namespace ThreadBudget {
+
+using Lease = std::vector<int>; // cpus granted to client
+
+struct Client {
+  virtual ~Client() = default;
+
+  // Called by manager each time client's lease changes, both when it shrinks
+  // and grows. Called under manager's lock: clients yielding cpus are notified
+  // before the ones receiving them. Must not call back into Manager.
+  virtual void OnLease(const Lease &lease) = 0;
+
+  // Called by manager when client is released: its pool isn't limited by
+  // the budget anymore and may go back to its own defaults. Called under
+  // manager's lock after remaining clients got their new leases.
+  virtual void OnUnmanaged() {}
+};
+
+// Lease snapshot which can be read from any thread, used by pinners.
+class LeasedCpus {
+public:
+  void Set(Lease lease) {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    Cpus_ = std::move(lease);
+    ++Epoch_;
+  }
+
+  Lease Get() const {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    return Cpus_;
+  }
+
+  size_t Size() const {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    return Cpus_.size();
+  }
+
+  // cpu for slot'th thread of the pool, -1 if nothing is leased yet
+  int CpuForSlot(size_t slot) const {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    return Cpus_.empty() ? -1 : Cpus_[slot % Cpus_.size()];
+  }
+
+  // changes every time lease is updated
+  uint64_t Epoch() const {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    return Epoch_;
+  }
+
+private:
+  mutable std::mutex Mutex_;
+  Lease Cpus_;
+  uint64_t Epoch_ = 0;
+};
+
+class Manager {
+public:
+  static Manager &Instance() {
+    static Manager manager(GetAvailableConcurrency());
+    return manager;
+  }
+
+  explicit Manager(size_t totalCpus) {
+    const auto &allowed = GetAllowedCpus();
+    totalCpus = std::max<size_t>(1, std::min(totalCpus, allowed.size()));
+    Cpus_.assign(allowed.begin(), allowed.begin() + totalCpus);
+  }
+
+  // Asks for `threads` cpus (at least one is always granted). Can be called
+  // again to change the request. Returns the granted lease, the same lease is
+  // passed to client->OnLease.
+  Lease Acquire(Client *client, size_t threads) {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    threads = std::max<size_t>(threads, 1);
+    auto it = Find(client);
+    if (it == Entries_.end()) {
+      Entries_.push_back(Entry{client, threads, {}});
+    } else {
+      it->Requested = threads;
+    }
+    Rebalance();
+    return Find(client)->Granted;
+  }
+
+  // Returns client's cpus to the budget, they are redistributed between
+  // remaining clients. Client itself gets no new lease, it's told it's
+  // unmanaged via Client::OnUnmanaged.
+  void Release(Client *client) {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    auto it = Find(client);
+    if (it == Entries_.end()) {
+      return;
+    }
+    Entries_.erase(it);
+    Rebalance();
+    client->OnUnmanaged();
+  }
+
+  size_t TotalCpus() const { return Cpus_.size(); }
+
+private:
+  struct Entry {
+    Client *Owner;
+    size_t Requested;
+    Lease Granted;
+  };
+
+  std::vector<Entry>::iterator Find(Client *client) {
+    return std::find_if(Entries_.begin(), Entries_.end(),
+                        [client](auto &&e) { return e.Owner == client; });
+  }
+
+  // Max-min fair shares: clients requesting less than equal share get what
+  // they asked, the rest is split equally between the others.
+  std::vector<size_t> ComputeShares() const {
+    std::vector<size_t> shares(Entries_.size());
+    std::vector<size_t> order(Entries_.size());
+    for (size_t i = 0; i != order.size(); ++i) {
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+      return Entries_[a].Requested < Entries_[b].Requested;
+    });
+    size_t remain = Cpus_.size();
+    for (size_t i = 0; i != order.size(); ++i) {
+      size_t clientsLeft = order.size() - i;
+      // everybody gets at least one cpu, even if it means oversubscription,
+      // remainder of integer division goes to the greediest clients
+      size_t fair = std::max<size_t>(1, remain / clientsLeft);
+      shares[order[i]] = std::min(Entries_[order[i]].Requested, fair);
+      remain -= std::min(remain, shares[order[i]]);
+    }
+    return shares;
+  }
+
+  void Rebalance() {
+    auto shares = ComputeShares();
+    std::vector<Lease> leases(Entries_.size());
+    std::vector<bool> used(Cpus_.size());
+    auto cpuIndex = [this](int cpu) {
+      return std::find(Cpus_.begin(), Cpus_.end(), cpu) - Cpus_.begin();
+    };
+    // keep placement stable: clients keep cpus they already have
+    for (size_t i = 0; i != Entries_.size(); ++i) {
+      for (int cpu : Entries_[i].Granted) {
+        size_t idx = cpuIndex(cpu);
+        if (leases[i].size() == shares[i]) {
+          break;
+        }
+        if (idx != Cpus_.size() && !used[idx]) {
+          used[idx] = true;
+          leases[i].push_back(cpu);
+        }
+      }
+    }
+    size_t next = 0;
+    for (size_t i = 0; i != Entries_.size(); ++i) {
+      while (leases[i].size() < shares[i] && next != Cpus_.size()) {
+        if (!used[next]) {
+          used[next] = true;
+          leases[i].push_back(Cpus_[next]);
+        }
+        ++next;
+      }
+      if (leases[i].empty()) {
+        // more clients than cpus, have to share
+        leases[i].push_back(Cpus_[i % Cpus_.size()]);
+      }
+    }
+    // notify yielding clients first, so cpus are released before reuse
+    for (bool shrink : {true, false}) {
+      for (size_t i = 0; i != Entries_.size(); ++i) {
+        auto &entry = Entries_[i];
+        if (leases[i] == entry.Granted ||
+            (leases[i].size() < entry.Granted.size()) != shrink) {
+          continue;
+        }
+        entry.Granted = leases[i];
+        entry.Owner->OnLease(entry.Granted);
+      }
+    }
+  }
+
+  std::mutex Mutex_;
+  Lease Cpus_;
+  std::vector<Entry> Entries_;
+};
+
+} // namespace ThreadBudget
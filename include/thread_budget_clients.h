@@ -0,0 +1,103 @@
+#pragma once
+#include "thread_budget.h"
+#include "util.h"
+
+#include <cstdint>
+#include <memory>
+
+#ifdef EIGEN_MODE
+#include "eigen_pinner.h"
+#endif
+
+#ifdef TBB_MODE
+#include "tbb_pinner.h"
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Adapters of runtime thread pools to ThreadBudget::Manager: each one resizes
+// its pool and moves threads to leased cpus in OnLease.
+namespace ThreadBudget {
+
+// Lease of `threads` threads without a budget: round-robin over allowed
+// cpus, as InitParallel pins them.
+inline Lease DefaultLease(size_t threads) {
+  const auto &allowed = GetAllowedCpus();
+  Lease lease;
+  for (size_t i = 0; i != threads; ++i) {
+    lease.push_back(allowed[i % allowed.size()]);
+  }
+  return lease;
+}
+
+#if defined(EIGEN_MODE) && EIGEN_MODE != EIGEN_RAPID
+// Deactivates workers beyond the lease and pins active ones to leased cpus.
+class EigenClient : public Client {
+public:
+  void OnLease(const Lease &lease) override {
+    EigenPool.SetActiveThreads(lease.size());
+    EigenPinner::PinWorkers(lease);
+  }
+
+  void OnUnmanaged() override { OnLease(DefaultLease(GetNumThreads())); }
+};
+#endif
+
+#ifdef TBB_MODE
+// Limits tbb parallelism by lease size, workers are pinned to leased cpus
+// when they enter the arena.
+class TbbClient : public Client {
+public:
+  TbbClient() : Pinner_(&Cpus_) {}
+
+  void OnLease(const Lease &lease) override {
+    Cpus_.Set(lease);
+    Limit_ = std::make_unique<tbb::global_control>(
+        tbb::global_control::max_allowed_parallelism, lease.size());
+  }
+
+  // limit of InitParallel applies again
+  void OnUnmanaged() override {
+    Cpus_.Set(DefaultLease(GetNumThreads()));
+    Limit_.reset();
+  }
+
+private:
+  LeasedCpus Cpus_;
+  PinningObserver Pinner_;
+  std::unique_ptr<tbb::global_control> Limit_;
+};
+#endif
+
+#ifdef _OPENMP
+// OpenMP team size can't be changed from outside, so regions should be opened
+// with num_threads(client.NumThreads()) and call EnterRegion() in each thread.
+class OmpClient : public Client {
+public:
+  void OnLease(const Lease &lease) override { Cpus_.Set(lease); }
+
+  void OnUnmanaged() override { Cpus_.Set(DefaultLease(GetNumThreads())); }
+
+  int NumThreads() const { return std::max<size_t>(1, Cpus_.Size()); }
+
+  // re-pins calling thread of the team if lease has changed since last call
+  void EnterRegion() const {
+    static thread_local std::pair<const OmpClient *, uint64_t> pinned{};
+    auto epoch = Cpus_.Epoch();
+    if (pinned.first == this && pinned.second == epoch) {
+      return;
+    }
+    if (auto cpu = Cpus_.CpuForSlot(omp_get_thread_num()); cpu >= 0) {
+      PinThreadToCpu(cpu);
+    }
+    pinned = {this, epoch};
+  }
+
+private:
+  LeasedCpus Cpus_;
+};
+#endif
+
+} // namespace ThreadBudget
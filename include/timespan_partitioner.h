@@ -1,15 +1,19 @@
 #pragma once
 #include "intrusive_ptr.h"
 #include "num_threads.h"
+#include "trace_buffer.h"
 #include "util.h"
 #include <array>
 #include <atomic>
 #include <cassert>
 #include <chrono>
 #include <cstddef>
+#include <cstdlib>
+#include <limits>
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 namespace EigenPartitioner {
 
@@ -49,7 +53,107 @@ struct TaskNode : intrusive_ref_counter<TaskNode> {
   std::atomic<size_t> ChildWaitingSteal_{0};
 };
 
-enum class Balance { OFF, SIMPLE, DELAYED };
+// DELAYED: split all the remaining range after INIT_TIME
+// HEARTBEAT: every HEARTBEAT_TIME promote one split (older half of the
+// remaining range), so splitting costs at most one spawn per heartbeat
+enum class Balance { OFF, SIMPLE, DELAYED, HEARTBEAT };
+
+// Summary of one ParallelFor call, times are in Now() units.
+struct ExecutionReport {
+  size_t DistributedTasks = 0; // spawned by initial distribution
+  size_t BalancingTasks = 0;   // split off for balancing
+  size_t MaxDepth = 0;         // of balancing splits
+  // per thread, the last one is for threads outside of the pool
+  std::vector<Timestamp> BusyCycles;
+  Timestamp LastStart = 0;    // from the call until the last thread started
+  Timestamp FinishSpread = 0; // from the first thread finished to the last
+
+  // max to mean busy time over pool threads, 1 is perfectly balanced
+  double Imbalance() const {
+    Timestamp max = 0;
+    Timestamp sum = 0;
+    for (size_t i = 0; i + 1 < BusyCycles.size(); ++i) {
+      max = std::max(max, BusyCycles[i]);
+      sum += BusyCycles[i];
+    }
+    return sum ? static_cast<double>(max) * (BusyCycles.size() - 1) / sum : 1;
+  }
+};
+
+// Collects ExecutionReport from tasks of one ParallelFor, each thread updates
+// its own padded slot.
+class ReportCollector {
+public:
+  explicit ReportCollector(size_t threads)
+      : Start_(Now()), Slots_(new Slot[threads + 1]), Threads_(threads) {}
+
+  void OnSpawned(bool balancing, size_t count = 1) {
+    (balancing ? BalancingTasks_ : DistributedTasks_)
+        .fetch_add(count, std::memory_order_relaxed);
+  }
+
+  // threadIndex is the scheduler's one, threads outside of it share a slot
+  void OnExecuted(ThreadId threadIndex, size_t depth, Timestamp start,
+                  Timestamp end) {
+    auto &slot = Slots_[std::min<size_t>(threadIndex, Threads_)];
+    slot.Busy.fetch_add(end - start, std::memory_order_relaxed);
+    AtomicMin(slot.FirstStart, start);
+    AtomicMax(slot.LastFinish, end);
+    AtomicMax(MaxDepth_, depth);
+  }
+
+  ExecutionReport Build() const {
+    ExecutionReport report;
+    report.DistributedTasks = DistributedTasks_.load(std::memory_order_relaxed);
+    report.BalancingTasks = BalancingTasks_.load(std::memory_order_relaxed);
+    report.MaxDepth = MaxDepth_.load(std::memory_order_relaxed);
+    Timestamp lastStart = Start_;
+    Timestamp firstFinish = std::numeric_limits<Timestamp>::max();
+    Timestamp lastFinish = 0;
+    for (size_t i = 0; i <= Threads_; ++i) {
+      auto &slot = Slots_[i];
+      report.BusyCycles.push_back(slot.Busy.load(std::memory_order_relaxed));
+      auto finish = slot.LastFinish.load(std::memory_order_relaxed);
+      if (finish != 0) {
+        lastStart = std::max(lastStart,
+                             slot.FirstStart.load(std::memory_order_relaxed));
+        firstFinish = std::min(firstFinish, finish);
+        lastFinish = std::max(lastFinish, finish);
+      }
+    }
+    report.LastStart = lastStart - Start_;
+    report.FinishSpread = lastFinish ? lastFinish - firstFinish : 0;
+    return report;
+  }
+
+private:
+  template <typename T> static void AtomicMin(std::atomic<T> &value, T x) {
+    auto current = value.load(std::memory_order_relaxed);
+    while (x < current && !value.compare_exchange_weak(
+                              current, x, std::memory_order_relaxed)) {
+    }
+  }
+
+  template <typename T> static void AtomicMax(std::atomic<T> &value, T x) {
+    auto current = value.load(std::memory_order_relaxed);
+    while (x > current && !value.compare_exchange_weak(
+                              current, x, std::memory_order_relaxed)) {
+    }
+  }
+
+  struct alignas(hardware_destructive_interference_size) Slot {
+    std::atomic<Timestamp> Busy{0};
+    std::atomic<Timestamp> FirstStart{std::numeric_limits<Timestamp>::max()};
+    std::atomic<Timestamp> LastFinish{0};
+  };
+
+  const Timestamp Start_;
+  std::unique_ptr<Slot[]> Slots_;
+  const size_t Threads_;
+  std::atomic<size_t> DistributedTasks_{0};
+  std::atomic<size_t> BalancingTasks_{0};
+  std::atomic<size_t> MaxDepth_{0};
+};
 
 enum class Initial { TRUE, FALSE };
 
@@ -58,10 +162,14 @@ enum class GrainSize { DEFAULT, AUTO };
 template <typename Scheduler, typename Func, Balance balance,
           GrainSize grainSizeMode, Initial initial = Initial::FALSE>
 struct Task {
-  static inline const uint64_t INIT_TIME = [] {
+  static inline const uint64_t INIT_TIME = []() -> uint64_t {
   // should be calculated using timespan_tuner with EIGEN_SIMPLE
   // currently 0.99 percentile for maximums is used: 99% of iterations should
-  // fit scheduling in timespan
+  // fit scheduling in timespan. INIT_TIME_NS overrides it, in nanoseconds, so
+  // one value may be used on machines with different clock rates.
+    if (const char *initTimeNs = std::getenv("INIT_TIME_NS")) {
+      return NsToCycles(std::atof(initTimeNs));
+    }
 #if defined(__x86_64__)
     if (GetNumThreads() == 48) {
       return 16500;
@@ -74,12 +182,18 @@ struct Task {
 #endif
   }();
 
+  // scheduling cost should be small compared to the heartbeat, so it's the
+  // same as INIT_TIME
+  static inline const uint64_t HEARTBEAT_TIME = INIT_TIME;
+
   using StolenFlag = std::atomic<bool>;
 
   Task(Scheduler &sched, TaskNode::NodePtr node, size_t from, size_t to,
-       Func func, SplitData split, ThreadId threadId)
+       Func func, SplitData split, ThreadId threadId,
+       ReportCollector *report = nullptr)
       : Sched_(sched), CurrentNode_(std::move(node)), Current_(from), End_(to),
-        Func_(std::move(func)), Split_(split), SupposedThread_(threadId) {}
+        Func_(std::move(func)), Split_(split), SupposedThread_(threadId),
+        Report_(report) {}
 
   bool IsDivisible() const { return Current_ + Split_.GrainSize < End_; }
 
@@ -119,11 +233,15 @@ struct Task {
                   Func_,
                   SplitData{.Threads = {otherThreads.From, threadSplit},
                             .GrainSize = Split_.GrainSize},
-                  static_cast<ThreadId>(otherThreads.From)},
+                  static_cast<ThreadId>(otherThreads.From), Report_},
               otherThreads.From);
+          SCHED_TRACE_POINT(SPAWN, otherThreads.From);
           otherThreads.From = threadSplit;
           otherData.From = dataSplit;
         }
+        if (Report_) {
+          Report_->OnSpawned(false, parts);
+        }
         assert(otherData.From == otherData.To);
         assert(otherThreads.From == otherThreads.To ||
                parts < Split_.K_SPLIT &&
@@ -134,6 +252,7 @@ struct Task {
   }
 
   void operator()() {
+    Timestamp taskStart = Report_ ? Now() : 0;
     if constexpr (initial == Initial::TRUE) {
       DistributeWork();
     }
@@ -144,6 +263,7 @@ struct Task {
       // at first we are executing job for INIT_TIME
       // and then create balancing task
       auto start = Now();
+      [[maybe_unused]] auto initFrom = Current_;
       while (Current_ < End_) {
         Execute();
         if (Now() - start > INIT_TIME) {
@@ -153,9 +273,23 @@ struct Task {
           Split_.GrainSize++;
         }
       }
+      SCHED_TRACE_POINT(INIT_END, Current_ - initFrom);
+    }
+
+    if constexpr (balance == Balance::HEARTBEAT) {
+      auto beat = Now();
+      while (Current_ != End_) {
+        Execute();
+        if (Now() - beat > HEARTBEAT_TIME) {
+          if (IsDivisible()) {
+            PromoteSplit();
+          }
+          beat = Now();
+        }
+      }
     }
 
-    if constexpr (balance != Balance::OFF) {
+    if constexpr (balance != Balance::OFF && balance != Balance::HEARTBEAT) {
       while (Current_ != End_ && IsDivisible()) {
         // make balancing tasks for remaining iterations
         // TODO: check stolen? maybe not each time?
@@ -169,7 +303,11 @@ struct Task {
         Sched_.run(Task<Scheduler, Func, Balance::SIMPLE, GrainSize::DEFAULT>{
             Sched_, new TaskNode(CurrentNode_), mid, End_, Func_,
             SplitData{.GrainSize = Split_.GrainSize, .Depth = Split_.Depth + 1},
-            GetThreadIndex()});
+            Sched_.thread_index(), Report_});
+        SCHED_TRACE_POINT(SPLIT, Split_.Depth + 1);
+        if (Report_) {
+          Report_->OnSpawned(true);
+        }
         End_ = mid;
       }
     }
@@ -177,10 +315,29 @@ struct Task {
     while (Current_ != End_) {
       Execute();
     }
+    if (Report_) {
+      Report_->OnExecuted(Sched_.thread_index(), Split_.Depth, taskStart,
+                          Now());
+    }
     CurrentNode_.Reset();
   }
 
 private:
+  // heartbeat split: upper half is the oldest latent work in the loop, it is
+  // spawned as a task which beats by itself
+  void PromoteSplit() {
+    size_t mid = Current_ + (End_ - Current_) / 2;
+    Sched_.run(Task<Scheduler, Func, Balance::HEARTBEAT, GrainSize::DEFAULT>{
+        Sched_, new TaskNode(CurrentNode_), mid, End_, Func_,
+        SplitData{.GrainSize = Split_.GrainSize, .Depth = Split_.Depth + 1},
+        Sched_.thread_index(), Report_});
+    SCHED_TRACE_POINT(SPLIT, Split_.Depth + 1);
+    if (Report_) {
+      Report_->OnSpawned(true);
+    }
+    End_ = mid;
+  }
+
   void Execute() {
     Func_(Current_);
     ++Current_;
@@ -194,6 +351,7 @@ private:
   ThreadId SupposedThread_;
 
   IntrusivePtr<TaskNode> CurrentNode_;
+  ReportCollector *Report_; // null unless report is requested
 };
 
 template <typename Sched, Balance balance, GrainSize grainSizeMode, typename F>
@@ -207,12 +365,20 @@ auto MakeInitialTask(Sched &sched, TaskNode::NodePtr node, size_t from,
       to,
       std::move(func),
       SplitData{.Threads = {0, threadCount}, .GrainSize = grainSize},
-      GetThreadIndex()};
+      sched.thread_index()};
 }
 
+// grainSize is the minimal size of a part to split off, in GrainSize::AUTO
+// mode it's only the initial value. If report is set, it's filled with
+// ExecutionReport of this call (this costs a few Now() calls per task).
 template <typename Sched, Balance balance, GrainSize grainSizeMode, typename F>
-void ParallelFor(size_t from, size_t to, F func) {
+void ParallelFor(size_t from, size_t to, F func, size_t grainSize = 1,
+                 ExecutionReport *report = nullptr) {
   Sched sched;
+  std::unique_ptr<ReportCollector> collector;
+  if (report) {
+    collector = std::make_unique<ReportCollector>(sched.num_threads());
+  }
   // allocating only for top-level nodes
   TaskNode rootNode;
   IntrusivePtrAddRef(&rootNode); // avoid deletion
@@ -222,32 +388,47 @@ void ParallelFor(size_t from, size_t to, F func) {
       from,
       to,
       std::move(func),
-      SplitData{.Threads = {0, static_cast<size_t>(GetNumThreads())},
-                .GrainSize = 1},
-      GetThreadIndex()};
+      SplitData{.Threads = {0, sched.num_threads()},
+                .GrainSize = std::max<size_t>(grainSize, 1)},
+      sched.thread_index(),
+      collector.get()};
   task();
-  sched.join_main_thread();
-  while (IntrusivePtrLoadRef(&rootNode) != 1) {
-    CpuRelax();
+  // caller steals until all tasks are finished, they may still be running
+  // when its own queue is empty
+  sched.join_main_thread([&] { return IntrusivePtrLoadRef(&rootNode) == 1; });
+  if (report) {
+    *report = collector->Build();
   }
 }
 
 template <typename Sched, GrainSize grainSizeMode, typename F>
-void ParallelForTimespan(size_t from, size_t to, F func) {
-  ParallelFor<Sched, Balance::DELAYED, grainSizeMode, F>(from, to,
-                                                         std::move(func));
+void ParallelForTimespan(size_t from, size_t to, F func,
+                         size_t grainSize = 1,
+                         ExecutionReport *report = nullptr) {
+  ParallelFor<Sched, Balance::DELAYED, grainSizeMode, F>(
+      from, to, std::move(func), grainSize, report);
+}
+
+template <typename Sched, typename F>
+void ParallelForSimple(size_t from, size_t to, F func, size_t grainSize = 1,
+                       ExecutionReport *report = nullptr) {
+  ParallelFor<Sched, Balance::SIMPLE, GrainSize::DEFAULT, F>(
+      from, to, std::move(func), grainSize, report);
 }
 
 template <typename Sched, typename F>
-void ParallelForSimple(size_t from, size_t to, F func) {
-  ParallelFor<Sched, Balance::SIMPLE, GrainSize::DEFAULT, F>(from, to,
-                                                             std::move(func));
+void ParallelForHeartbeat(size_t from, size_t to, F func,
+                          size_t grainSize = 1,
+                          ExecutionReport *report = nullptr) {
+  ParallelFor<Sched, Balance::HEARTBEAT, GrainSize::DEFAULT, F>(
+      from, to, std::move(func), grainSize, report);
 }
 
 template <typename Sched, typename F>
-void ParallelForStatic(size_t from, size_t to, F func) {
-  ParallelFor<Sched, Balance::OFF, GrainSize::DEFAULT, F>(from, to,
-                                                          std::move(func));
+void ParallelForStatic(size_t from, size_t to, F func, size_t grainSize = 1,
+                       ExecutionReport *report = nullptr) {
+  ParallelFor<Sched, Balance::OFF, GrainSize::DEFAULT, F>(
+      from, to, std::move(func), grainSize, report);
 }
 
 } // namespace EigenPartitioner
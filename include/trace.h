@@ -61,6 +61,51 @@ struct IterationResult {
   Timestamp End;
 };
 
+// JSON read by benchplot.py, tasks are grouped by thread
+inline std::string ToJson(const std::vector<IterationResult> &results,
+                          size_t threadNum) {
+  std::stringstream stream;
+  stream << "{\n"
+         << "\"thread_num\": " << threadNum << ",\n"
+         << "\"tasks_num\": " << results.front().Tasks.size() << ",\n"
+         << "\"ticks_per_ns\": " << TicksPerNs() << ",\n"
+         << "\"results\": [\n";
+  for (size_t iter = 0; iter != results.size(); ++iter) {
+    auto &&res = results[iter].Tasks;
+    std::unordered_map<ThreadId, std::vector<Tracing::TaskInfo>>
+        resultPerThread;
+    for (size_t i = 0; i < res.size(); ++i) {
+      auto task = res[i];
+      resultPerThread[task.ThreadIdx].emplace_back(task);
+    }
+    stream << "  {\n"
+           << "    \"start\": " << results[iter].Start << ",\n"
+           << "    \"end\": " << results[iter].End << ",\n"
+           << "    \"tasks\": {\n";
+    size_t total = 0;
+    for (auto &&[id, tasks] : resultPerThread) {
+      stream << "        \"" << id << "\": [";
+      std::sort(tasks.begin(), tasks.end());
+      for (size_t i = 0; i != tasks.size(); ++i) {
+        auto task = tasks[i];
+        stream << "{\"index\": " << task.TaskIdx << ", \"trace\": {\""
+               << "prev_trace\": " << task.Trace.PreviousTrace
+               << ", \"execution_start\": " << task.Trace.ExecutionStart
+               << ", \"execution_end\": " << task.Trace.ExecutionEnd
+               << "}, \"cpu\": " << task.SchedCpu << "}"
+               << (i == tasks.size() - 1 ? "" : ", ");
+      }
+      stream << (++total == resultPerThread.size() ? "]" : "],") << "\n";
+    }
+    stream << "    }"
+           << "\n"
+           << (iter + 1 == results.size() ? "  }" : "  },") << "\n";
+  }
+  stream << "]\n"
+         << "}\n";
+  return stream.str();
+}
+
 class Tracer {
 public:
   Tracer() = default;
@@ -90,46 +135,7 @@ public:
   }
 
   std::string ToJson(size_t threadNum) {
-    std::stringstream stream;
-    auto &results = Iterations;
-    stream << "{\n"
-           << "\"thread_num\": " << threadNum << ",\n"
-           << "\"tasks_num\": " << results.front().Tasks.size() << ",\n"
-           << "\"results\": [\n";
-    for (size_t iter = 0; iter != results.size(); ++iter) {
-      auto &&res = results[iter].Tasks;
-      std::unordered_map<ThreadId, std::vector<Tracing::TaskInfo>>
-          resultPerThread;
-      for (size_t i = 0; i < res.size(); ++i) {
-        auto task = res[i];
-        resultPerThread[task.ThreadIdx].emplace_back(task);
-      }
-      stream << "  {\n"
-             << "    \"start\": " << results[iter].Start << ",\n"
-             << "    \"end\": " << results[iter].End << ",\n"
-             << "    \"tasks\": {\n";
-      size_t total = 0;
-      for (auto &&[id, tasks] : resultPerThread) {
-        stream << "        \"" << id << "\": [";
-        std::sort(tasks.begin(), tasks.end());
-        for (size_t i = 0; i != tasks.size(); ++i) {
-          auto task = tasks[i];
-          stream << "{\"index\": " << task.TaskIdx << ", \"trace\": {\""
-                 << "prev_trace\": " << task.Trace.PreviousTrace
-                 << ", \"execution_start\": " << task.Trace.ExecutionStart
-                 << ", \"execution_end\": " << task.Trace.ExecutionEnd
-                 << "}, \"cpu\": " << task.SchedCpu << "}"
-                 << (i == tasks.size() - 1 ? "" : ", ");
-        }
-        stream << (++total == resultPerThread.size() ? "]" : "],") << "\n";
-      }
-      stream << "    }"
-             << "\n"
-             << (iter + 1 == results.size() ? "  }" : "  },") << "\n";
-    }
-    stream << "]\n"
-           << "}\n";
-    return stream.str();
+    return Tracing::ToJson(Iterations, threadNum);
   }
 
 private:
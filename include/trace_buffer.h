@@ -0,0 +1,209 @@
+#pragma once
+#include "clock.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <sched.h>
+#include <vector>
+
+// Per-thread binary trace buffers, used by RingTracer and by scheduler trace
+// points. Only depends on the clock, so the pool can include it.
+//
+// SCHED_TRACE enables trace points inside the partitioner and EigenPool, they
+// write to the buffers of the active RingTracer.
+#ifdef SCHED_TRACE
+#define SCHED_TRACE_POINT(kind, arg)                                           \
+  ::Tracing::TracePoint(::Tracing::EventKind::kind, (arg))
+#else
+#define SCHED_TRACE_POINT(kind, arg) ((void)0)
+#endif
+
+namespace Tracing {
+
+enum class EventKind : uint8_t {
+  ITERATION_START, // Arg is number of tasks
+  ITERATION_END,
+  TASK_START, // Arg is task index
+  TASK_END,
+  // scheduler trace points
+  SPAWN,        // DistributeWork sent a part, Arg is the thread
+  SPLIT,        // balancing split off a task, Arg is its depth
+  INIT_END,     // initial INIT_TIME phase ended, Arg is iterations done
+  PUSH,         // task pushed, Arg is where it went (PushResult)
+  STEAL,        // Arg is victim's slot
+  STEAL_FAILED, // steal scan found nothing, Arg is victims checked
+  IDLE_START,   // worker has nothing to run and starts waiting
+  IDLE_END,
+};
+
+enum PushResult : uint32_t { PUSH_QUEUE, PUSH_RUNNEXT, PUSH_FULL };
+
+inline constexpr uint16_t NO_CPU = 0xffff;
+
+// Fixed binary record, 4 of them fit into a cache line.
+struct Record {
+  Timestamp Time;
+  uint32_t Arg;
+  uint16_t Cpu; // NO_CPU if it wasn't read
+  EventKind Kind;
+  uint8_t Reserved;
+};
+static_assert(sizeof(Record) == 16);
+
+// Now() and the cpu it was read on: Linux keeps cpu in TSC_AUX, so rdtscp
+// gives it without a syscall or vDSO call.
+inline Timestamp NowOnCpu(uint16_t &cpu) {
+#if defined(__x86_64__)
+  unsigned aux;
+  auto time = __rdtscp(&aux);
+  cpu = aux & 0xfff;
+  return time;
+#else
+  cpu = NO_CPU;
+  return Now();
+#endif
+}
+
+// Records of one thread. Only the owner writes, the oldest records are
+// overwritten when it's full. Read it only when writer is quiescent.
+class alignas(64) RingBuffer {
+public:
+  // capacity must be a power of two, memory is touched here, so the run
+  // doesn't page fault
+  explicit RingBuffer(size_t capacity)
+      : Mask_(capacity - 1), Records_(new Record[capacity]()) {
+    assert((capacity & Mask_) == 0);
+  }
+
+  void Write(Timestamp time, uint32_t arg, EventKind kind,
+             uint16_t cpu = NO_CPU) {
+    Records_[Head_ & Mask_] = Record{time, arg, cpu, kind, 0};
+    ++Head_;
+  }
+
+  size_t Size() const { return std::min(Head_, Mask_ + 1); }
+
+  size_t Dropped() const { return Head_ - Size(); }
+
+  // from the oldest to the newest
+  template <typename F> void ForEach(F &&func) const {
+    for (size_t i = Head_ - Size(); i != Head_; ++i) {
+      func(Records_[i & Mask_]);
+    }
+  }
+
+  int Thread = -1; // index of the owner when it registered
+  int Cpu = -1;    // of the owner when it registered
+
+private:
+  size_t Head_ = 0;
+  const size_t Mask_;
+  std::unique_ptr<Record[]> Records_;
+};
+
+// Buffers of one trace, a thread takes one on its first record (only this
+// takes a lock).
+class TraceBuffers {
+public:
+  // capacity is in records per thread, buffers for `threads` threads are
+  // allocated here, others on first use. threadIndex is called once per
+  // thread to name its buffer.
+  TraceBuffers(size_t threads, size_t capacity, int (*threadIndex)())
+      : Capacity_(RoundUpPow2(capacity)), Id_(NextId()),
+        ThreadIndex_(threadIndex) {
+    for (size_t i = 0; i != threads; ++i) {
+      Buffers_.emplace_back(new RingBuffer(Capacity_));
+    }
+  }
+
+  TraceBuffers(const TraceBuffers &) = delete;
+  TraceBuffers &operator=(const TraceBuffers &) = delete;
+
+  // pool must be quiescent, idle workers may still write otherwise
+  ~TraceBuffers() { Deactivate(); }
+
+  // buffers scheduler trace points write to, null if there are none
+  static std::atomic<TraceBuffers *> &Active() {
+    static std::atomic<TraceBuffers *> active{nullptr};
+    return active;
+  }
+
+  void Activate() { Active().store(this, std::memory_order_release); }
+
+  void Deactivate() {
+    auto *self = this;
+    Active().compare_exchange_strong(self, nullptr);
+  }
+
+  RingBuffer &Local() {
+    static thread_local uint64_t owner = 0;
+    static thread_local RingBuffer *buffer = nullptr;
+    if (owner != Id_) {
+      buffer = Register();
+      owner = Id_;
+    }
+    return *buffer;
+  }
+
+  // records lost because some buffer was full, call after the run
+  size_t Dropped() const {
+    size_t dropped = 0;
+    ForEach([&](size_t, const RingBuffer &buffer) {
+      dropped += buffer.Dropped();
+    });
+    return dropped;
+  }
+
+  // func(index, buffer) for every used buffer, call after the run
+  template <typename F> void ForEach(F &&func) const {
+    for (size_t i = 0; i != Used_; ++i) {
+      func(i, *Buffers_[i]);
+    }
+  }
+
+private:
+  static size_t RoundUpPow2(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+      result *= 2;
+    }
+    return result;
+  }
+
+  static uint64_t NextId() {
+    static std::atomic<uint64_t> id{0};
+    return ++id;
+  }
+
+  RingBuffer *Register() {
+    std::lock_guard<std::mutex> lock(Mutex_);
+    if (Used_ == Buffers_.size()) {
+      Buffers_.emplace_back(new RingBuffer(Capacity_));
+    }
+    auto *buffer = Buffers_[Used_++].get();
+    buffer->Thread = ThreadIndex_();
+    buffer->Cpu = sched_getcpu();
+    return buffer;
+  }
+
+  const size_t Capacity_;
+  const uint64_t Id_;
+  int (*const ThreadIndex_)();
+  std::mutex Mutex_;
+  std::vector<std::unique_ptr<RingBuffer>> Buffers_; // guarded by Mutex_
+  size_t Used_ = 0;                                  // guarded by Mutex_
+};
+
+inline void TracePoint(EventKind kind, uint64_t arg) {
+  if (auto *buffers = TraceBuffers::Active().load(std::memory_order_acquire)) {
+    buffers->Local().Write(Now(), static_cast<uint32_t>(arg), kind);
+  }
+}
+
+} // namespace Tracing
@@ -0,0 +1,1415 @@
+// Implements core entry points of libgomp (GCC) and libomp (clang) ABIs on
+// top of EigenPool, so unmodified OpenMP binaries can be run on our scheduler:
+//   LD_PRELOAD=libeigen_omp_shim.so ./bench_reduce_OMP_STATIC
+//
+// Parallel regions are launched as EigenPartitioner::ParallelForTimespan over
+// team members, so each member gets its own worker through DistributeWork.
+// Worksharing loops can't be handed to the partitioner as is: compiler pulls
+// chunks from inside the outlined function. Dynamic and guided loops are
+// scheduled the same way as timespan partitioner does it - iterations are
+// split between team members statically and idle members steal half of
+// remaining iterations of others.
+//
+// Explicit tasks are queued to the team and run by members waiting at
+// barriers, taskwait and taskgroup ends; a task waits for its children before
+// it completes. Tasks with dependences are run undeferred after all previous
+// siblings.
+//
+// Not supported: nested parallelism (inner regions are serialized), ordered
+// loops, task reductions, cancellation, copyprivate, teams. Their entry points
+// abort with a message, so they never reach the real runtime with our gtids.
+
+#include "../include/parallel_for.h"
+#include "../include/spin_lock.h"
+
+#include <array>
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace OmpShim {
+
+using Iter = uint64_t;
+
+enum class Kind { STATIC, DYNAMIC, GUIDED };
+
+struct Schedule {
+  Kind Type;
+  Iter Chunk; // 0 means default
+  bool Monotonic = false;
+};
+
+// OMP_SCHEDULE for schedule(runtime), timespan-like dynamic by default
+inline Schedule RuntimeSchedule() {
+  static const Schedule schedule = [] {
+    Schedule res{Kind::DYNAMIC, 1};
+    const char *env = std::getenv("OMP_SCHEDULE");
+    if (!env) {
+      return res;
+    }
+    std::string value = env;
+    if (auto colon = value.find(':'); colon != std::string::npos) {
+      res.Monotonic = value.compare(0, colon, "monotonic") == 0;
+      value = value.substr(colon + 1);
+    }
+    auto comma = value.find(',');
+    auto kind = value.substr(0, comma);
+    if (kind == "static") {
+      res = Schedule{Kind::STATIC, 0};
+    } else if (kind == "guided") {
+      res.Type = Kind::GUIDED;
+    }
+    if (comma != std::string::npos) {
+      res.Chunk = std::stoull(value.substr(comma + 1));
+    }
+    return res;
+  }();
+  return schedule;
+}
+
+// Contiguous block of i'th of `parts` members, as schedule(static) does.
+inline std::pair<Iter, Iter> StaticBlock(Iter n, Iter i, Iter parts) {
+  Iter step = n / parts;
+  Iter mod = n % parts;
+  Iter from = i * step + std::min(i, mod);
+  return {from, from + step + (i < mod)};
+}
+
+[[noreturn]] inline void Unsupported(const char *name) {
+  std::fprintf(stderr, "omp_shim: %s isn't supported\n", name);
+  std::abort();
+}
+
+struct TeamBarrier {
+  explicit TeamBarrier(int size) : Size(size) {}
+
+  // Waiting members call runTask() (returns false if there was nothing to
+  // run), the last one releases the barrier when allDone() says all tasks of
+  // the team are finished.
+  template <typename R, typename D> void Wait(R &&runTask, D &&allDone) {
+    auto generation = Generation.load(std::memory_order_acquire);
+    if (Arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == Size) {
+      while (!allDone()) {
+        if (!runTask()) {
+          CpuRelax();
+        }
+      }
+      Arrived.store(0, std::memory_order_relaxed);
+      Generation.fetch_add(1, std::memory_order_release);
+      return;
+    }
+    while (Generation.load(std::memory_order_acquire) == generation) {
+      if (!runTask()) {
+        CpuRelax();
+      }
+    }
+  }
+
+  const int Size;
+  std::atomic<int> Arrived{0};
+  std::atomic<uint64_t> Generation{0};
+};
+
+struct alignas(hardware_destructive_interference_size) MemberRange {
+  SpinLock Lock;
+  Iter From = 0;
+  Iter To = 0;
+};
+
+// State of one worksharing construct (loop or single) shared by the team.
+// Constructs are numbered in order of encountering, each member passes
+// through all of them, so a few slots are reused in a ring.
+struct WorkShare {
+  static constexpr size_t SLOTS = 4;
+
+  void Init(Iter n, Schedule schedule, int teamSize) {
+    Sched = schedule;
+    Sched.Chunk = std::max<Iter>(Sched.Chunk, 1);
+    for (int i = 0; i != teamSize; ++i) {
+      auto [from, to] = StaticBlock(n, i, teamSize);
+      Ranges[i].From = from;
+      Ranges[i].To = to;
+    }
+  }
+
+  bool Next(int member, int teamSize, Iter &from, Iter &to) {
+    if (TakeOwn(member, from, to)) {
+      return true;
+    }
+    if (Sched.Type == Kind::STATIC) {
+      return false;
+    }
+    // steal half of the remaining iterations, monotonic schedules can steal
+    // only from members with greater iterations
+    int victims = Sched.Monotonic ? teamSize - member - 1 : teamSize - 1;
+    for (int i = 1; i <= victims; ++i) {
+      auto &victim = Ranges[(member + i) % teamSize];
+      Iter stolenFrom, stolenTo;
+      {
+        std::lock_guard<SpinLock> lock(victim.Lock);
+        Iter remain = victim.To - victim.From;
+        if (remain == 0) {
+          continue;
+        }
+        Iter take = remain <= Sched.Chunk ? remain : remain / 2;
+        stolenTo = victim.To;
+        stolenFrom = victim.To - take;
+        victim.To = stolenFrom;
+      }
+      {
+        auto &own = Ranges[member];
+        std::lock_guard<SpinLock> lock(own.Lock);
+        own.From = stolenFrom;
+        own.To = stolenTo;
+      }
+      return TakeOwn(member, from, to);
+    }
+    return false;
+  }
+
+  std::atomic<uint64_t> Claimed{0};
+  std::atomic<uint64_t> Ready{0};
+  std::atomic<int> Left{0};
+  Schedule Sched{Kind::STATIC, 1};
+  std::unique_ptr<MemberRange[]> Ranges;
+
+private:
+  bool TakeOwn(int member, Iter &from, Iter &to) {
+    auto &own = Ranges[member];
+    std::lock_guard<SpinLock> lock(own.Lock);
+    if (own.From == own.To) {
+      return false;
+    }
+    Iter size = own.To - own.From;
+    if (Sched.Type == Kind::DYNAMIC) {
+      size = std::min(size, Sched.Chunk);
+    } else if (Sched.Type == Kind::GUIDED) {
+      size = std::min(size, std::max(Sched.Chunk, (size + 1) / 2));
+    }
+    from = own.From;
+    to = own.From + size;
+    own.From = to;
+    return true;
+  }
+};
+
+// Explicit task waiting in the team queue, it's counted in counters of its
+// parent task and of its taskgroup until it completes.
+struct QueuedTask {
+  std::function<void()> Body;
+  std::atomic<int> *Parent;
+  std::atomic<int> *Group; // null outside of taskgroups
+};
+
+struct Team {
+  explicit Team(int size) : Size(size), Barrier(size) {
+    for (auto &ws : WorkShares) {
+      ws.Ranges.reset(new MemberRange[size]);
+    }
+  }
+
+  const int Size;
+  TeamBarrier Barrier;
+  std::array<WorkShare, WorkShare::SLOTS> WorkShares;
+  std::mutex TasksMutex;
+  std::deque<QueuedTask> Tasks;     // guarded by TasksMutex
+  std::atomic<int> PendingTasks{0}; // queued and running
+};
+
+// Loop in normalized form: iteration k is Start + k * Incr (in modular
+// arithmetic, so it works for any integer type and direction).
+struct Loop {
+  uint64_t Start = 0;
+  uint64_t Incr = 1;
+  Iter Count = 0;
+  Schedule Sched{Kind::STATIC, 0};
+  WorkShare *Shared = nullptr; // null for static loops, they need no state
+  Iter StaticChunkIdx = 0;
+  bool Active = false;
+};
+
+struct ThreadState {
+  Team *CurrentTeam = nullptr;
+  int Member = 0;
+  int Level = 0;
+  uint64_t WorkShareCount = 0;
+  Loop CurrentLoop;
+  std::atomic<int> *Children = nullptr; // of the current (implicit) task
+  std::atomic<int> *Group = nullptr;    // innermost taskgroup
+};
+
+inline ThreadState &Current() {
+  static thread_local ThreadState state;
+  return state;
+}
+
+// nthreads-var ICV, per thread approximation
+inline int &MaxThreadsIcv() {
+  static thread_local int threads = [] {
+    if (const char *env = std::getenv("OMP_NUM_THREADS")) {
+      return std::max(1, std::atoi(env));
+    }
+    return EigenPool.NumActiveThreads();
+  }();
+  return threads;
+}
+
+// Enters next worksharing construct of the team, returns true for the member
+// that has to initialize it. Initializer must call Publish.
+inline std::pair<WorkShare *, bool> EnterWorkShare() {
+  auto &state = Current();
+  auto id = ++state.WorkShareCount;
+  auto &ws = state.CurrentTeam->WorkShares[id % WorkShare::SLOTS];
+  uint64_t prev = id > WorkShare::SLOTS ? id - WorkShare::SLOTS : 0;
+  while (true) {
+    auto ready = ws.Ready.load(std::memory_order_acquire);
+    if (ready == id) {
+      return {&ws, false};
+    }
+    // slot is free when all members have left the previous construct
+    if (ready == prev && ws.Left.load(std::memory_order_acquire) == 0) {
+      uint64_t expected = prev;
+      if (ws.Claimed.compare_exchange_strong(expected, id,
+                                             std::memory_order_acq_rel)) {
+        return {&ws, true};
+      }
+    }
+    CpuRelax();
+  }
+}
+
+inline void Publish(WorkShare *ws) {
+  auto &state = Current();
+  ws->Left.store(state.CurrentTeam->Size, std::memory_order_relaxed);
+  ws->Ready.store(state.WorkShareCount, std::memory_order_release);
+}
+
+inline void LeaveWorkShare(WorkShare *ws) {
+  ws->Left.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+inline void StartLoop(uint64_t start, uint64_t incr, Iter count,
+                      Schedule schedule) {
+  auto &state = Current();
+  auto &loop = state.CurrentLoop;
+  loop = Loop{start, incr, count, schedule};
+  loop.Active = true;
+  // static schedules are computed per member and need no shared state,
+  // orphaned loops are run by a single thread
+  if (schedule.Type == Kind::STATIC || !state.CurrentTeam) {
+    return;
+  }
+  auto [ws, init] = EnterWorkShare();
+  if (init) {
+    ws->Init(count, schedule, state.CurrentTeam->Size);
+    Publish(ws);
+  }
+  loop.Shared = ws;
+}
+
+inline void FinishLoop() {
+  auto &loop = Current().CurrentLoop;
+  if (loop.Active && loop.Shared) {
+    LeaveWorkShare(loop.Shared);
+  }
+  loop.Active = false;
+  loop.Shared = nullptr;
+}
+
+// next chunk [from, to) of normalized iterations for the calling member
+inline bool NextChunk(Iter &from, Iter &to) {
+  auto &state = Current();
+  auto &loop = state.CurrentLoop;
+  if (!loop.Active) {
+    return false;
+  }
+  bool found = false;
+  auto size = state.CurrentTeam ? state.CurrentTeam->Size : 1;
+  if (loop.Shared) {
+    found = loop.Shared->Next(state.Member, size, from, to);
+  } else if (loop.Sched.Chunk == 0) {
+    // one contiguous block per member
+    if (loop.StaticChunkIdx++ == 0) {
+      std::tie(from, to) = StaticBlock(loop.Count, state.Member, size);
+      found = from != to;
+    }
+  } else {
+    // round-robin chunks
+    Iter idx = loop.StaticChunkIdx++ * size + state.Member;
+    from = idx * loop.Sched.Chunk;
+    to = std::min(loop.Count, from + loop.Sched.Chunk);
+    found = from < loop.Count;
+  }
+  if (!found) {
+    FinishLoop();
+  }
+  return found;
+}
+
+inline void WaitCounter(std::atomic<int> *counter);
+
+// Runs body(member) on a team of `threads` members.
+template <typename F> void Fork(unsigned threads, F &&body) {
+  // pin workers and warm the pool up, as benchmarks do
+  static InitOnce init{[] { InitParallel(EigenPool.NumThreads()); }};
+
+  auto &state = Current();
+  int size = threads ? threads : MaxThreadsIcv();
+  if (state.CurrentTeam) {
+    // nested regions are serialized, pool's workers are already busy
+    size = 1;
+  }
+  size = std::max(1, std::min(size, EigenPool.NumActiveThreads()));
+  auto level = state.Level + 1;
+
+  Team team(size);
+  auto runMember = [&team, &body, level](size_t member) {
+    auto &state = Current();
+    auto saved = state;
+    std::atomic<int> children{0};
+    state = ThreadState{&team, static_cast<int>(member), level};
+    state.Children = &children;
+    body(static_cast<int>(member));
+    // tasks are finished by the end of the region; members don't wait for
+    // each other here, concurrent teams may have to share workers
+    WaitCounter(&team.PendingTasks);
+    state = saved;
+  };
+  if (size == 1) {
+    runMember(0);
+    return;
+  }
+  // there are not more members than threads, so each member gets its own
+  // worker and runs without any delay (see Task::DistributeWork); regions of
+  // different threads take turns, otherwise members of one team could wait at
+  // a barrier for workers busy with another team
+  static std::mutex teams;
+  std::lock_guard<std::mutex> lock(teams);
+  EigenPartitioner::ParallelForTimespan<EigenPoolWrapper,
+                                        EigenPartitioner::GrainSize::DEFAULT>(
+      0, size, runMember);
+}
+
+inline bool RunQueuedTask();
+
+inline void Barrier() {
+  auto *team = Current().CurrentTeam;
+  if (team && team->Size > 1) {
+    team->Barrier.Wait(RunQueuedTask, [team] {
+      return team->PendingTasks.load(std::memory_order_acquire) == 0;
+    });
+  }
+}
+
+// Runs body as a task of the current thread: children it spawns are waited
+// for before it completes, so their counter can live on its stack.
+inline void ExecuteTask(const std::function<void()> &body,
+                        std::atomic<int> *group) {
+  auto &state = Current();
+  auto *savedChildren = state.Children;
+  auto *savedGroup = state.Group;
+  std::atomic<int> children{0};
+  state.Children = &children;
+  state.Group = group;
+  body();
+  while (children.load(std::memory_order_acquire) != 0) {
+    if (!RunQueuedTask()) {
+      CpuRelax();
+    }
+  }
+  state.Children = savedChildren;
+  state.Group = savedGroup;
+}
+
+// takes a task of the team and runs it, false if there was none
+inline bool RunQueuedTask() {
+  auto *team = Current().CurrentTeam;
+  if (!team || team->PendingTasks.load(std::memory_order_relaxed) == 0) {
+    return false;
+  }
+  QueuedTask task;
+  {
+    std::lock_guard<std::mutex> lock(team->TasksMutex);
+    if (team->Tasks.empty()) {
+      return false;
+    }
+    task = std::move(team->Tasks.front());
+    team->Tasks.pop_front();
+  }
+  ExecuteTask(task.Body, task.Group);
+  task.Parent->fetch_sub(1, std::memory_order_acq_rel);
+  if (task.Group) {
+    task.Group->fetch_sub(1, std::memory_order_acq_rel);
+  }
+  team->PendingTasks.fetch_sub(1, std::memory_order_acq_rel);
+  return true;
+}
+
+// Deferred task, teams of one (and orphaned constructs) run it at once.
+inline void SpawnTask(std::function<void()> body) {
+  auto &state = Current();
+  auto *team = state.CurrentTeam;
+  if (!team || team->Size == 1 || !state.Children) {
+    ExecuteTask(body, state.Group);
+    return;
+  }
+  state.Children->fetch_add(1, std::memory_order_relaxed);
+  if (state.Group) {
+    state.Group->fetch_add(1, std::memory_order_relaxed);
+  }
+  team->PendingTasks.fetch_add(1, std::memory_order_relaxed);
+  std::lock_guard<std::mutex> lock(team->TasksMutex);
+  team->Tasks.push_back(QueuedTask{std::move(body), state.Children, state.Group});
+}
+
+inline void WaitCounter(std::atomic<int> *counter) {
+  while (counter && counter->load(std::memory_order_acquire) != 0) {
+    if (!RunQueuedTask()) {
+      CpuRelax();
+    }
+  }
+}
+
+inline void TaskWait() { WaitCounter(Current().Children); }
+
+// taskgroups are started and ended by the same task on one thread
+inline std::vector<std::unique_ptr<std::atomic<int>>> &TaskGroups() {
+  static thread_local std::vector<std::unique_ptr<std::atomic<int>>> groups;
+  return groups;
+}
+
+inline void TaskGroupStart() {
+  auto &groups = TaskGroups();
+  groups.push_back(std::make_unique<std::atomic<int>>(0));
+  Current().Group = groups.back().get();
+}
+
+inline void TaskGroupEnd() {
+  auto &groups = TaskGroups();
+  WaitCounter(groups.back().get());
+  groups.pop_back();
+  // enclosing group of this task, if it's still on this thread's stack
+  auto &state = Current();
+  state.Group = groups.empty() ? nullptr : groups.back().get();
+}
+
+inline bool SingleStart() {
+  auto &state = Current();
+  if (!state.CurrentTeam) {
+    return true;
+  }
+  auto [ws, init] = EnterWorkShare();
+  if (init) {
+    Publish(ws);
+  }
+  LeaveWorkShare(ws);
+  return init;
+}
+
+inline std::mutex &CriticalMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+inline std::mutex &AtomicMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+// mutex of a named critical section, created on first use in the storage the
+// compiler reserved for the name (never freed, as in the runtimes)
+inline std::mutex &NamedMutex(void *slot) {
+  auto *ref = reinterpret_cast<std::atomic<std::mutex *> *>(slot);
+  auto *mutex = ref->load(std::memory_order_acquire);
+  if (!mutex) {
+    auto *created = new std::mutex;
+    if (ref->compare_exchange_strong(mutex, created,
+                                     std::memory_order_acq_rel)) {
+      mutex = created;
+    } else {
+      delete created;
+    }
+  }
+  return *mutex;
+}
+
+// iteration count of [start, end) with step incr, both directions
+inline Iter CountLong(long start, long end, long incr) {
+  if (incr > 0) {
+    return end > start ? (end - start + incr - 1) / incr : 0;
+  }
+  return start > end ? (start - end - incr - 1) / -incr : 0;
+}
+
+inline Iter CountULL(bool up, unsigned long long start, unsigned long long end,
+                     unsigned long long incr) {
+  if (up) {
+    return end > start ? (end - start + incr - 1) / incr : 0;
+  }
+  // incr is negative here
+  return start > end ? (start - end - incr - 1) / -incr : 0;
+}
+
+// iteration count of [lb, ub] (inclusive) with step st, libomp style
+template <typename T, typename ST> Iter CountInclusive(T lb, T ub, ST st) {
+  using U = std::make_unsigned_t<T>;
+  using UST = std::make_unsigned_t<ST>;
+  if (st > 0) {
+    return ub >= lb ? static_cast<U>(ub - lb) / static_cast<UST>(st) + 1 : 0;
+  }
+  return lb >= ub ? static_cast<U>(lb - ub) / static_cast<UST>(-st) + 1 : 0;
+}
+
+template <typename T> T IterValue(Iter k) {
+  auto &loop = Current().CurrentLoop;
+  return static_cast<T>(loop.Start + k * loop.Incr);
+}
+
+// GOMP helpers, chunks are returned as [istart, iend)
+template <typename T> bool GompNext(T *istart, T *iend) {
+  Iter from, to;
+  if (!NextChunk(from, to)) {
+    return false;
+  }
+  *istart = IterValue<T>(from);
+  *iend = IterValue<T>(to);
+  return true;
+}
+
+inline bool GompStartLong(long start, long end, long incr, Schedule schedule,
+                          long *istart, long *iend) {
+  StartLoop(start, incr, CountLong(start, end, incr), schedule);
+  return GompNext(istart, iend);
+}
+
+inline bool GompStartULL(bool up, unsigned long long start,
+                         unsigned long long end, unsigned long long incr,
+                         Schedule schedule, unsigned long long *istart,
+                         unsigned long long *iend) {
+  StartLoop(start, incr, CountULL(up, start, end, incr), schedule);
+  return GompNext(istart, iend);
+}
+
+inline Schedule GompSchedule(long sched, long chunk) {
+  // GFS_RUNTIME, GFS_STATIC, GFS_DYNAMIC, GFS_GUIDED, GFS_AUTO
+  bool monotonic = sched & 0x80000000L;
+  switch (sched & 0x7fffffffL) {
+  case 1:
+    return {Kind::STATIC, static_cast<Iter>(chunk), monotonic};
+  case 2:
+    return {Kind::DYNAMIC, static_cast<Iter>(chunk), monotonic};
+  case 3:
+    return {Kind::GUIDED, static_cast<Iter>(chunk), monotonic};
+  default:
+    return RuntimeSchedule();
+  }
+}
+
+// flags of GOMP_task and GOMP_taskloop
+enum GompTaskFlag : unsigned {
+  GOMP_TASK_DEPEND = 1 << 3,
+  GOMP_TASK_UP = 1 << 8,
+  GOMP_TASK_GRAINSIZE = 1 << 9,
+  GOMP_TASK_IF = 1 << 10,
+  GOMP_TASK_NOGROUP = 1 << 11,
+  GOMP_TASK_REDUCTION = 1 << 12,
+  GOMP_TASK_DETACH = 1 << 13,
+};
+
+// Task gets its own copy of the argument block, firstprivates are
+// constructed by cpyfn if there is one.
+inline void GompTask(void (*fn)(void *), void *data,
+                     void (*cpyfn)(void *, void *), long size, long align,
+                     bool deferred,
+                     const std::function<void(void *)> &prepare = {}) {
+  align = std::max(align, 1L);
+  auto *buffer = static_cast<char *>(std::malloc(size + align - 1));
+  void *arg = buffer + (-reinterpret_cast<uintptr_t>(buffer) & (align - 1));
+  if (cpyfn) {
+    cpyfn(arg, data);
+  } else {
+    std::memcpy(arg, data, size);
+  }
+  if (prepare) {
+    prepare(arg);
+  }
+  auto body = [fn, arg, buffer] {
+    fn(arg);
+    std::free(buffer);
+  };
+  if (deferred) {
+    SpawnTask(body);
+  } else {
+    ExecuteTask(body, Current().Group);
+  }
+}
+
+// Iterations of a taskloop are split into blocks as schedule(static) does,
+// bounds of a block are the first two values of its argument block.
+template <typename T>
+void GompTaskloop(void (*fn)(void *), void *data,
+                  void (*cpyfn)(void *, void *), long size, long align,
+                  unsigned flags, unsigned long tasks, T start, T step,
+                  Iter count) {
+  if (flags & (GOMP_TASK_REDUCTION | GOMP_TASK_DETACH)) {
+    Unsupported("GOMP_taskloop with reductions");
+  }
+  if (count == 0) {
+    return;
+  }
+  auto *team = Current().CurrentTeam;
+  Iter chunks = team ? team->Size : 1;
+  if (flags & GOMP_TASK_GRAINSIZE) {
+    chunks = std::max<Iter>(count / std::max<Iter>(tasks, 1), 1);
+  } else if (tasks) {
+    chunks = tasks;
+  }
+  chunks = std::min(chunks, count);
+  bool group = !(flags & GOMP_TASK_NOGROUP);
+  if (group) {
+    TaskGroupStart();
+  }
+  for (Iter i = 0; i != chunks; ++i) {
+    auto [from, to] = StaticBlock(count, i, chunks);
+    GompTask(fn, data, cpyfn, size, align, flags & GOMP_TASK_IF,
+             [=](void *arg) {
+               static_cast<T *>(arg)[0] = start + static_cast<T>(from) * step;
+               static_cast<T *>(arg)[1] = start + static_cast<T>(to) * step;
+             });
+  }
+  if (group) {
+    TaskGroupEnd();
+  }
+}
+
+// libomp helpers
+namespace Kmp {
+enum SchedType {
+  STATIC_CHUNKED = 33,
+  STATIC = 34,
+  DYNAMIC_CHUNKED = 35,
+  GUIDED_CHUNKED = 36,
+  RUNTIME = 37,
+  AUTO = 38,
+  STATIC_BALANCED = 41,
+  GUIDED_ITERATIVE = 42,
+  GUIDED_ANALYTICAL = 43,
+  STATIC_STEAL = 44,
+  MONOTONIC = 1 << 29,
+  NONMONOTONIC = 1 << 30,
+};
+
+inline Schedule ToSchedule(int32_t sched, int64_t chunk) {
+  bool monotonic = sched & MONOTONIC;
+  switch (sched & ~(MONOTONIC | NONMONOTONIC)) {
+  case STATIC:
+  case STATIC_BALANCED:
+    return {Kind::STATIC, 0};
+  case STATIC_CHUNKED:
+    return {Kind::STATIC, static_cast<Iter>(chunk)};
+  case DYNAMIC_CHUNKED:
+  case STATIC_STEAL:
+    return {Kind::DYNAMIC, static_cast<Iter>(chunk), monotonic};
+  case GUIDED_CHUNKED:
+  case GUIDED_ITERATIVE:
+  case GUIDED_ANALYTICAL:
+    return {Kind::GUIDED, static_cast<Iter>(chunk), monotonic};
+  case RUNTIME:
+    return RuntimeSchedule();
+  default:
+    // auto and anything we don't know: let timespan-like stealing decide
+    return {Kind::DYNAMIC, 1};
+  }
+}
+
+template <typename T, typename ST>
+void ForStaticInit(int32_t schedtype, int32_t *plastiter, T *plower, T *pupper,
+                   ST *pstride, ST incr, ST chunk) {
+  auto &state = Current();
+  int size = state.CurrentTeam ? state.CurrentTeam->Size : 1;
+  int member = state.Member;
+  Iter n = CountInclusive(*plower, *pupper, incr);
+  auto schedule = ToSchedule(schedtype, chunk);
+  if (n == 0) {
+    if (plastiter) {
+      *plastiter = 0;
+    }
+    *pstride = incr;
+    return;
+  }
+  T lower = *plower;
+  auto value = [lower, incr](Iter k) {
+    return static_cast<T>(lower + static_cast<T>(k * static_cast<Iter>(incr)));
+  };
+  if (schedule.Type == Kind::STATIC && schedule.Chunk != 0) {
+    // compiler iterates over [lower, upper] chunks adding stride and
+    // clamping upper to the original bound
+    Iter chunkSize = schedule.Chunk;
+    *plower = value(member * chunkSize);
+    *pupper = value(member * chunkSize + chunkSize - 1);
+    *pstride = static_cast<ST>(chunkSize * size * incr);
+    if (plastiter) {
+      *plastiter = ((n - 1) / chunkSize) % size == static_cast<Iter>(member);
+    }
+    return;
+  }
+  auto [from, to] = StaticBlock(n, member, size);
+  T upper = *pupper;
+  if (from == to) {
+    // empty block: lower is past upper
+    *plower = static_cast<T>(upper + incr);
+    *pupper = upper;
+  } else {
+    *plower = value(from);
+    *pupper = value(to - 1);
+  }
+  *pstride = static_cast<ST>(n * incr);
+  if (plastiter) {
+    *plastiter = to == n && from != to;
+  }
+}
+
+template <typename T, typename ST>
+void DispatchInit(int32_t schedule, T lb, T ub, ST st, ST chunk) {
+  StartLoop(static_cast<uint64_t>(lb), static_cast<uint64_t>(st),
+            CountInclusive(lb, ub, st), ToSchedule(schedule, chunk));
+}
+
+// chunks are returned as [lower, upper]
+template <typename T, typename ST>
+int DispatchNext(int32_t *plast, T *plower, T *pupper, ST *pstride) {
+  Iter from, to;
+  auto count = Current().CurrentLoop.Count;
+  if (!NextChunk(from, to)) {
+    return 0;
+  }
+  *plower = IterValue<T>(from);
+  *pupper = IterValue<T>(to - 1);
+  if (pstride) {
+    *pstride = static_cast<ST>(Current().CurrentLoop.Incr);
+  }
+  if (plast) {
+    *plast = to == count;
+  }
+  return 1;
+}
+
+// kmp_task_t, the task's privates follow it
+struct Task;
+using TaskRoutine = int32_t (*)(int32_t gtid, Task *task);
+struct Task {
+  void *shareds;
+  TaskRoutine routine;
+  int32_t part_id;
+  TaskRoutine destructors; // data1
+  void *priority;          // data2
+};
+
+enum TaskFlag : int32_t {
+  TASK_DESTRUCTORS = 1 << 3,
+  TASK_DETACHABLE = 1 << 6,
+};
+
+// header of a task allocation, shareds are after privates of the task
+struct alignas(16) TaskHeader {
+  size_t Size;
+  int32_t Flags;
+};
+
+inline TaskHeader *HeaderOf(Task *task) {
+  return reinterpret_cast<TaskHeader *>(task) - 1;
+}
+
+inline Task *AllocTask(int32_t flags, size_t taskSize, size_t sharedsSize,
+                       TaskRoutine routine) {
+  if (flags & TASK_DETACHABLE) {
+    Unsupported("detachable tasks");
+  }
+  taskSize = (taskSize + alignof(void *) - 1) & ~(alignof(void *) - 1);
+  size_t size = sizeof(TaskHeader) + taskSize + sharedsSize;
+  auto *header = static_cast<TaskHeader *>(std::malloc(size));
+  header->Size = size;
+  header->Flags = flags;
+  auto *task = reinterpret_cast<Task *>(header + 1);
+  task->shareds =
+      sharedsSize ? reinterpret_cast<char *>(task) + taskSize : nullptr;
+  task->routine = routine;
+  task->part_id = 0;
+  return task;
+}
+
+inline void FreeTask(Task *task) {
+  if (HeaderOf(task)->Flags & TASK_DESTRUCTORS) {
+    task->destructors(Current().Member, task);
+  }
+  std::free(HeaderOf(task));
+}
+
+inline void RunTask(Task *task) {
+  task->routine(Current().Member, task);
+  FreeTask(task);
+}
+
+// copy of a taskloop's pattern task, shareds are moved with it
+inline Task *CopyTask(Task *task) {
+  auto *header = HeaderOf(task);
+  auto *copy = static_cast<TaskHeader *>(std::malloc(header->Size));
+  std::memcpy(copy, header, header->Size);
+  auto *result = reinterpret_cast<Task *>(copy + 1);
+  if (task->shareds) {
+    result->shareds = reinterpret_cast<char *>(result) +
+                      (static_cast<char *>(task->shareds) -
+                       reinterpret_cast<char *>(task));
+  }
+  return result;
+}
+
+using TaskDup = void (*)(Task *dst, Task *src, int32_t lastpriv);
+
+// Iterations are split into blocks as schedule(static) does, each block is a
+// copy of the pattern task with its bounds, privates are set up by dup.
+inline void Taskloop(Task *task, int32_t ifVal, uint64_t *lb, uint64_t *ub,
+                     int64_t st, int32_t nogroup, int32_t sched,
+                     uint64_t grainsize, TaskDup dup) {
+  auto lbOffset = reinterpret_cast<char *>(lb) - reinterpret_cast<char *>(task);
+  auto ubOffset = reinterpret_cast<char *>(ub) - reinterpret_cast<char *>(task);
+  // clang passes the normalized iteration space, ub is inclusive
+  auto lower = static_cast<int64_t>(*lb);
+  auto upper = static_cast<int64_t>(*ub);
+  Iter count = 0;
+  if (st > 0 && upper >= lower) {
+    count = (upper - lower) / st + 1;
+  } else if (st < 0 && lower >= upper) {
+    count = (lower - upper) / -st + 1;
+  }
+  auto *team = Current().CurrentTeam;
+  // as libomp, 10 tasks per member without grainsize and num_tasks
+  Iter chunks = team ? team->Size * 10 : 1;
+  if (sched == 1) {
+    chunks = std::max<Iter>(count / std::max<uint64_t>(grainsize, 1), 1);
+  } else if (sched == 2) {
+    chunks = std::max<uint64_t>(grainsize, 1);
+  }
+  chunks = std::min(chunks, count);
+  if (!nogroup) {
+    TaskGroupStart();
+  }
+  for (Iter i = 0; i != chunks; ++i) {
+    auto [from, to] = StaticBlock(count, i, chunks);
+    auto *chunk = CopyTask(task);
+    auto *base = reinterpret_cast<char *>(chunk);
+    *reinterpret_cast<uint64_t *>(base + lbOffset) = lower + from * st;
+    *reinterpret_cast<uint64_t *>(base + ubOffset) = lower + (to - 1) * st;
+    if (dup) {
+      dup(chunk, task, i + 1 == chunks);
+    }
+    if (ifVal) {
+      SpawnTask([chunk] { RunTask(chunk); });
+    } else {
+      ExecuteTask([chunk] { RunTask(chunk); }, Current().Group);
+    }
+  }
+  FreeTask(task);
+  if (!nogroup) {
+    TaskGroupEnd();
+  }
+}
+} // namespace Kmp
+
+} // namespace OmpShim
+
+using namespace OmpShim;
+
+extern "C" {
+
+// OpenMP API
+
+int omp_get_thread_num() { return Current().Member; }
+
+int omp_get_num_threads() {
+  auto *team = Current().CurrentTeam;
+  return team ? team->Size : 1;
+}
+
+int omp_get_max_threads() { return MaxThreadsIcv(); }
+
+void omp_set_num_threads(int threads) { MaxThreadsIcv() = std::max(1, threads); }
+
+int omp_in_parallel() { return omp_get_num_threads() > 1; }
+
+int omp_get_level() { return Current().Level; }
+
+int omp_get_num_procs() { return GetAvailableConcurrency(); }
+
+double omp_get_wtime() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// libgomp ABI
+
+void GOMP_parallel(void (*fn)(void *), void *data, unsigned num_threads,
+                   unsigned flags) {
+  Fork(num_threads, [fn, data](int) { fn(data); });
+}
+
+void GOMP_barrier() { Barrier(); }
+
+bool GOMP_single_start() { return SingleStart(); }
+
+void GOMP_critical_start() { CriticalMutex().lock(); }
+
+void GOMP_critical_end() { CriticalMutex().unlock(); }
+
+void GOMP_critical_name_start(void **pptr) { NamedMutex(pptr).lock(); }
+
+void GOMP_critical_name_end(void **pptr) { NamedMutex(pptr).unlock(); }
+
+// atomics the compiler can't do natively
+void GOMP_atomic_start() { AtomicMutex().lock(); }
+
+void GOMP_atomic_end() { AtomicMutex().unlock(); }
+
+void GOMP_loop_end() {
+  FinishLoop();
+  Barrier();
+}
+
+void GOMP_loop_end_nowait() { FinishLoop(); }
+
+bool GOMP_loop_start(long start, long end, long incr, long sched,
+                     long chunk_size, long *istart, long *iend,
+                     uintptr_t *reductions, void **mem) {
+  // reductions and allocations through the runtime aren't supported
+  if (reductions || mem) {
+    Unsupported("GOMP_loop_start with reductions");
+  }
+  return GompStartLong(start, end, incr, GompSchedule(sched, chunk_size),
+                       istart, iend);
+}
+
+bool GOMP_loop_ull_start(bool up, unsigned long long start,
+                         unsigned long long end, unsigned long long incr,
+                         long sched, unsigned long long chunk_size,
+                         unsigned long long *istart, unsigned long long *iend,
+                         uintptr_t *reductions, void **mem) {
+  if (reductions || mem) {
+    Unsupported("GOMP_loop_ull_start with reductions");
+  }
+  return GompStartULL(up, start, end, incr, GompSchedule(sched, chunk_size),
+                      istart, iend);
+}
+
+#define SHIM_GOMP_LOOP(name, kind, monotonic)                                  \
+  bool GOMP_loop_##name##_start(long start, long end, long incr,               \
+                                long chunk_size, long *istart, long *iend) {   \
+    return GompStartLong(                                                      \
+        start, end, incr,                                                      \
+        Schedule{kind, static_cast<Iter>(chunk_size), monotonic}, istart,      \
+        iend);                                                                 \
+  }                                                                            \
+  bool GOMP_loop_##name##_next(long *istart, long *iend) {                     \
+    return GompNext(istart, iend);                                             \
+  }                                                                            \
+  bool GOMP_loop_ull_##name##_start(                                           \
+      bool up, unsigned long long start, unsigned long long end,               \
+      unsigned long long incr, unsigned long long chunk_size,                  \
+      unsigned long long *istart, unsigned long long *iend) {                  \
+    return GompStartULL(up, start, end, incr,                                  \
+                        Schedule{kind, chunk_size, monotonic}, istart, iend);  \
+  }                                                                            \
+  bool GOMP_loop_ull_##name##_next(unsigned long long *istart,                 \
+                                   unsigned long long *iend) {                 \
+    return GompNext(istart, iend);                                             \
+  }                                                                            \
+  void GOMP_parallel_loop_##name(void (*fn)(void *), void *data,               \
+                                 unsigned num_threads, long start, long end,   \
+                                 long incr, long chunk_size, unsigned flags) { \
+    Schedule schedule{kind, static_cast<Iter>(chunk_size), monotonic};         \
+    Fork(num_threads, [=](int) {                                               \
+      StartLoop(start, incr, CountLong(start, end, incr), schedule);           \
+      fn(data);                                                                \
+    });                                                                        \
+  }
+
+SHIM_GOMP_LOOP(static, Kind::STATIC, true)
+SHIM_GOMP_LOOP(dynamic, Kind::DYNAMIC, true)
+SHIM_GOMP_LOOP(guided, Kind::GUIDED, true)
+SHIM_GOMP_LOOP(nonmonotonic_dynamic, Kind::DYNAMIC, false)
+SHIM_GOMP_LOOP(nonmonotonic_guided, Kind::GUIDED, false)
+
+#undef SHIM_GOMP_LOOP
+
+#define SHIM_GOMP_RUNTIME_LOOP(name)                                           \
+  bool GOMP_loop_##name##_start(long start, long end, long incr, long *istart, \
+                                long *iend) {                                  \
+    return GompStartLong(start, end, incr, RuntimeSchedule(), istart, iend);   \
+  }                                                                            \
+  bool GOMP_loop_##name##_next(long *istart, long *iend) {                     \
+    return GompNext(istart, iend);                                             \
+  }                                                                            \
+  bool GOMP_loop_ull_##name##_start(                                           \
+      bool up, unsigned long long start, unsigned long long end,               \
+      unsigned long long incr, unsigned long long *istart,                     \
+      unsigned long long *iend) {                                              \
+    return GompStartULL(up, start, end, incr, RuntimeSchedule(), istart,       \
+                        iend);                                                 \
+  }                                                                            \
+  bool GOMP_loop_ull_##name##_next(unsigned long long *istart,                 \
+                                   unsigned long long *iend) {                 \
+    return GompNext(istart, iend);                                             \
+  }                                                                            \
+  void GOMP_parallel_loop_##name(void (*fn)(void *), void *data,               \
+                                 unsigned num_threads, long start, long end,   \
+                                 long incr, unsigned flags) {                  \
+    Fork(num_threads, [=](int) {                                               \
+      StartLoop(start, incr, CountLong(start, end, incr), RuntimeSchedule());  \
+      fn(data);                                                                \
+    });                                                                        \
+  }
+
+SHIM_GOMP_RUNTIME_LOOP(runtime)
+SHIM_GOMP_RUNTIME_LOOP(maybe_nonmonotonic_runtime)
+
+#undef SHIM_GOMP_RUNTIME_LOOP
+
+void GOMP_task(void (*fn)(void *), void *data, void (*cpyfn)(void *, void *),
+               long arg_size, long arg_align, bool if_clause, unsigned flags,
+               void **depend, int priority, void *detach) {
+  if (flags & GOMP_TASK_DETACH) {
+    Unsupported("GOMP_task with detach");
+  }
+  // dependences are satisfied by waiting for all previous siblings
+  if (flags & GOMP_TASK_DEPEND) {
+    TaskWait();
+    if_clause = false;
+  }
+  GompTask(fn, data, cpyfn, arg_size, arg_align, if_clause);
+}
+
+void GOMP_taskwait() { TaskWait(); }
+
+void GOMP_taskwait_depend(void **) { TaskWait(); }
+
+void GOMP_taskyield() { RunQueuedTask(); }
+
+void GOMP_taskgroup_start() { TaskGroupStart(); }
+
+void GOMP_taskgroup_end() { TaskGroupEnd(); }
+
+void GOMP_taskloop(void (*fn)(void *), void *data,
+                   void (*cpyfn)(void *, void *), long arg_size,
+                   long arg_align, unsigned flags, unsigned long num_tasks,
+                   int priority, long start, long end, long step) {
+  GompTaskloop<long>(fn, data, cpyfn, arg_size, arg_align, flags, num_tasks,
+                     start, step, CountLong(start, end, step));
+}
+
+void GOMP_taskloop_ull(void (*fn)(void *), void *data,
+                       void (*cpyfn)(void *, void *), long arg_size,
+                       long arg_align, unsigned flags, unsigned long num_tasks,
+                       int priority, unsigned long long start,
+                       unsigned long long end, unsigned long long step) {
+  GompTaskloop<unsigned long long>(
+      fn, data, cpyfn, arg_size, arg_align, flags, num_tasks, start, step,
+      CountULL(flags & GOMP_TASK_UP, start, end, step));
+}
+
+// Entry points of unsupported features abort instead of falling through to
+// the real runtime, which doesn't know our threads.
+#define SHIM_UNSUPPORTED(name)                                                 \
+  void name() { Unsupported(#name); }
+
+SHIM_UNSUPPORTED(GOMP_ordered_start)
+SHIM_UNSUPPORTED(GOMP_ordered_end)
+SHIM_UNSUPPORTED(GOMP_cancel)
+SHIM_UNSUPPORTED(GOMP_cancellation_point)
+SHIM_UNSUPPORTED(GOMP_barrier_cancel)
+SHIM_UNSUPPORTED(GOMP_loop_end_cancel)
+SHIM_UNSUPPORTED(GOMP_single_copy_start)
+SHIM_UNSUPPORTED(GOMP_single_copy_end)
+SHIM_UNSUPPORTED(GOMP_sections_start)
+SHIM_UNSUPPORTED(GOMP_sections2_start)
+SHIM_UNSUPPORTED(GOMP_sections_next)
+SHIM_UNSUPPORTED(GOMP_parallel_sections)
+SHIM_UNSUPPORTED(GOMP_sections_end)
+SHIM_UNSUPPORTED(GOMP_sections_end_nowait)
+SHIM_UNSUPPORTED(GOMP_parallel_reductions)
+SHIM_UNSUPPORTED(GOMP_taskgroup_reduction_register)
+SHIM_UNSUPPORTED(GOMP_taskgroup_reduction_unregister)
+SHIM_UNSUPPORTED(GOMP_task_reduction_remap)
+SHIM_UNSUPPORTED(GOMP_workshare_task_reduction_unregister)
+SHIM_UNSUPPORTED(GOMP_loop_ordered_start)
+SHIM_UNSUPPORTED(GOMP_loop_ordered_static_start)
+SHIM_UNSUPPORTED(GOMP_loop_ordered_dynamic_start)
+SHIM_UNSUPPORTED(GOMP_loop_ordered_guided_start)
+SHIM_UNSUPPORTED(GOMP_loop_ordered_runtime_start)
+SHIM_UNSUPPORTED(GOMP_loop_doacross_start)
+SHIM_UNSUPPORTED(GOMP_doacross_post)
+SHIM_UNSUPPORTED(GOMP_doacross_wait)
+SHIM_UNSUPPORTED(GOMP_teams_reg)
+SHIM_UNSUPPORTED(GOMP_teams4)
+
+// libomp ABI
+
+struct ident_t;
+using kmp_int32 = int32_t;
+using kmp_uint32 = uint32_t;
+using kmp_int64 = int64_t;
+using kmp_uint64 = uint64_t;
+typedef void (*kmpc_micro)(kmp_int32 *global_tid, kmp_int32 *bound_tid, ...);
+using kmp_critical_name = kmp_int32[8];
+
+kmp_int32 __kmpc_global_thread_num(ident_t *) { return Current().Member; }
+
+kmp_int32 __kmpc_ok_to_fork(ident_t *) { return 1; }
+
+static thread_local kmp_int32 PushedNumThreads = 0;
+
+// teams of one for if(false) regions, state of enclosing region is restored
+// on exit
+static thread_local std::vector<std::pair<ThreadState, std::unique_ptr<Team>>>
+    SerializedTeams;
+
+void __kmpc_push_num_threads(ident_t *, kmp_int32, kmp_int32 num_threads) {
+  PushedNumThreads = num_threads;
+}
+
+void __kmpc_fork_call(ident_t *, kmp_int32 argc, kmpc_micro microtask, ...) {
+  // up to 15 shared variables are passed by pointer
+  constexpr kmp_int32 MAX_ARGS = 15;
+  if (argc > MAX_ARGS) {
+    Unsupported("__kmpc_fork_call with more than 15 arguments");
+  }
+  void *args[MAX_ARGS];
+  va_list ap;
+  va_start(ap, microtask);
+  for (kmp_int32 i = 0; i != argc; ++i) {
+    args[i] = va_arg(ap, void *);
+  }
+  va_end(ap);
+  auto threads = std::exchange(PushedNumThreads, 0);
+  Fork(threads, [argc, microtask, &args](int member) {
+    kmp_int32 gtid = member;
+    kmp_int32 btid = member;
+    auto *a = args;
+    switch (argc) {
+    // clang-format off
+    case 0: microtask(&gtid, &btid); break;
+    case 1: microtask(&gtid, &btid, a[0]); break;
+    case 2: microtask(&gtid, &btid, a[0], a[1]); break;
+    case 3: microtask(&gtid, &btid, a[0], a[1], a[2]); break;
+    case 4: microtask(&gtid, &btid, a[0], a[1], a[2], a[3]); break;
+    case 5: microtask(&gtid, &btid, a[0], a[1], a[2], a[3], a[4]); break;
+    case 6: microtask(&gtid, &btid, a[0], a[1], a[2], a[3], a[4], a[5]); break;
+    case 7: microtask(&gtid, &btid, a[0], a[1], a[2], a[3], a[4], a[5], a[6]); break;
+    case 8: microtask(&gtid, &btid, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]); break;
+    case 9: microtask(&gtid, &btid, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8]); break;
+    case 10: microtask(&gtid, &btid, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9]); break;
+    case 11: microtask(&gtid, &btid, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10]); break;
+    case 12: microtask(&gtid, &btid, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10], a[11]); break;
+    case 13: microtask(&gtid, &btid, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10], a[11], a[12]); break;
+    case 14: microtask(&gtid, &btid, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10], a[11], a[12], a[13]); break;
+    case 15: microtask(&gtid, &btid, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10], a[11], a[12], a[13], a[14]); break;
+    // clang-format on
+    }
+  });
+}
+
+void __kmpc_serialized_parallel(ident_t *, kmp_int32) {
+  auto &state = Current();
+  SerializedTeams.push_back({state, std::make_unique<Team>(1)});
+  state = ThreadState{SerializedTeams.back().second.get(), 0, state.Level + 1};
+}
+
+void __kmpc_end_serialized_parallel(ident_t *, kmp_int32) {
+  Current() = SerializedTeams.back().first;
+  SerializedTeams.pop_back();
+}
+
+void __kmpc_barrier(ident_t *, kmp_int32) { Barrier(); }
+
+kmp_int32 __kmpc_single(ident_t *, kmp_int32) { return SingleStart(); }
+
+void __kmpc_end_single(ident_t *, kmp_int32) {}
+
+kmp_int32 __kmpc_master(ident_t *, kmp_int32) {
+  return Current().Member == 0;
+}
+
+void __kmpc_end_master(ident_t *, kmp_int32) {}
+
+void __kmpc_for_static_fini(ident_t *, kmp_int32) {}
+
+void __kmpc_critical(ident_t *, kmp_int32, kmp_critical_name *crit) {
+  NamedMutex(crit).lock();
+}
+
+void __kmpc_critical_with_hint(ident_t *, kmp_int32, kmp_critical_name *crit,
+                               uint32_t) {
+  NamedMutex(crit).lock();
+}
+
+void __kmpc_end_critical(ident_t *, kmp_int32, kmp_critical_name *crit) {
+  NamedMutex(crit).unlock();
+}
+
+// Reductions always take the critical section method: 1 tells the member to
+// combine its partial result into the shared one under the lock.
+kmp_int32 __kmpc_reduce_nowait(ident_t *, kmp_int32, kmp_int32, size_t,
+                               void *, void (*)(void *, void *),
+                               kmp_critical_name *lck) {
+  NamedMutex(lck).lock();
+  return 1;
+}
+
+void __kmpc_end_reduce_nowait(ident_t *, kmp_int32, kmp_critical_name *lck) {
+  NamedMutex(lck).unlock();
+}
+
+kmp_int32 __kmpc_reduce(ident_t *, kmp_int32, kmp_int32, size_t, void *,
+                        void (*)(void *, void *), kmp_critical_name *lck) {
+  NamedMutex(lck).lock();
+  return 1;
+}
+
+void __kmpc_end_reduce(ident_t *, kmp_int32, kmp_critical_name *lck) {
+  NamedMutex(lck).unlock();
+  Barrier();
+}
+
+kmp_int32 __kmpc_cancel_barrier(ident_t *, kmp_int32) {
+  Barrier();
+  return 0;
+}
+
+void __kmpc_flush(ident_t *) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void __kmpc_push_proc_bind(ident_t *, kmp_int32, int) {}
+
+Kmp::Task *__kmpc_omp_task_alloc(ident_t *, kmp_int32, kmp_int32 flags,
+                                 size_t sizeof_kmp_task_t,
+                                 size_t sizeof_shareds,
+                                 Kmp::TaskRoutine task_entry) {
+  return Kmp::AllocTask(flags, sizeof_kmp_task_t, sizeof_shareds, task_entry);
+}
+
+kmp_int32 __kmpc_omp_task(ident_t *, kmp_int32, Kmp::Task *task) {
+  SpawnTask([task] { Kmp::RunTask(task); });
+  return 0;
+}
+
+// dependences are satisfied by waiting for all previous siblings
+kmp_int32 __kmpc_omp_task_with_deps(ident_t *, kmp_int32, Kmp::Task *task,
+                                    kmp_int32, void *, kmp_int32, void *) {
+  TaskWait();
+  ExecuteTask([task] { Kmp::RunTask(task); }, Current().Group);
+  return 0;
+}
+
+void __kmpc_omp_wait_deps(ident_t *, kmp_int32, kmp_int32, void *, kmp_int32,
+                          void *) {
+  TaskWait();
+}
+
+// undeferred task, the compiler calls its routine in between
+void __kmpc_omp_task_begin_if0(ident_t *, kmp_int32, Kmp::Task *) {}
+
+void __kmpc_omp_task_complete_if0(ident_t *, kmp_int32, Kmp::Task *task) {
+  Kmp::FreeTask(task);
+}
+
+kmp_int32 __kmpc_omp_taskwait(ident_t *, kmp_int32) {
+  TaskWait();
+  return 0;
+}
+
+void __kmpc_omp_taskwait_deps_51(ident_t *, kmp_int32, kmp_int32, void *,
+                                 kmp_int32, void *, kmp_int32) {
+  TaskWait();
+}
+
+kmp_int32 __kmpc_omp_taskyield(ident_t *, kmp_int32, int) {
+  RunQueuedTask();
+  return 0;
+}
+
+void __kmpc_taskgroup(ident_t *, kmp_int32) { TaskGroupStart(); }
+
+void __kmpc_end_taskgroup(ident_t *, kmp_int32) { TaskGroupEnd(); }
+
+void __kmpc_taskloop(ident_t *, kmp_int32, Kmp::Task *task, int if_val,
+                     kmp_uint64 *lb, kmp_uint64 *ub, kmp_int64 st,
+                     int nogroup, int sched, kmp_uint64 grainsize,
+                     Kmp::TaskDup task_dup) {
+  Kmp::Taskloop(task, if_val, lb, ub, st, nogroup, sched, grainsize, task_dup);
+}
+
+void __kmpc_taskloop_5(ident_t *, kmp_int32, Kmp::Task *task, int if_val,
+                       kmp_uint64 *lb, kmp_uint64 *ub, kmp_int64 st,
+                       int nogroup, int sched, kmp_uint64 grainsize, int,
+                       Kmp::TaskDup task_dup) {
+  Kmp::Taskloop(task, if_val, lb, ub, st, nogroup, sched, grainsize, task_dup);
+}
+
+SHIM_UNSUPPORTED(__kmpc_ordered)
+SHIM_UNSUPPORTED(__kmpc_end_ordered)
+SHIM_UNSUPPORTED(__kmpc_cancel)
+SHIM_UNSUPPORTED(__kmpc_cancellationpoint)
+SHIM_UNSUPPORTED(__kmpc_copyprivate)
+SHIM_UNSUPPORTED(__kmpc_fork_teams)
+SHIM_UNSUPPORTED(__kmpc_push_num_teams)
+SHIM_UNSUPPORTED(__kmpc_doacross_init)
+SHIM_UNSUPPORTED(__kmpc_doacross_wait)
+SHIM_UNSUPPORTED(__kmpc_doacross_post)
+SHIM_UNSUPPORTED(__kmpc_doacross_fini)
+SHIM_UNSUPPORTED(__kmpc_taskred_init)
+SHIM_UNSUPPORTED(__kmpc_taskred_modifier_init)
+SHIM_UNSUPPORTED(__kmpc_task_reduction_init)
+SHIM_UNSUPPORTED(__kmpc_task_reduction_modifier_init)
+SHIM_UNSUPPORTED(__kmpc_task_reduction_get_th_data)
+SHIM_UNSUPPORTED(__kmpc_task_allow_completion_event)
+SHIM_UNSUPPORTED(__kmpc_omp_target_task_alloc)
+
+#undef SHIM_UNSUPPORTED
+
+#define SHIM_KMPC_LOOP(suffix, T, ST)                                          \
+  void __kmpc_for_static_init_##suffix(ident_t *, kmp_int32,                   \
+                                       kmp_int32 schedtype,                    \
+                                       kmp_int32 *plastiter, T *plower,        \
+                                       T *pupper, ST *pstride, ST incr,        \
+                                       ST chunk) {                             \
+    Kmp::ForStaticInit<T, ST>(schedtype, plastiter, plower, pupper, pstride,   \
+                              incr, chunk);                                    \
+  }                                                                            \
+  void __kmpc_dispatch_init_##suffix(ident_t *, kmp_int32,                     \
+                                     kmp_int32 schedule, T lb, T ub, ST st,    \
+                                     ST chunk) {                               \
+    Kmp::DispatchInit<T, ST>(schedule, lb, ub, st, chunk);                     \
+  }                                                                            \
+  int __kmpc_dispatch_next_##suffix(ident_t *, kmp_int32, kmp_int32 *p_last,   \
+                                    T *p_lb, T *p_ub, ST *p_st) {              \
+    return Kmp::DispatchNext<T, ST>(p_last, p_lb, p_ub, p_st);                 \
+  }                                                                            \
+  void __kmpc_dispatch_fini_##suffix(ident_t *, kmp_int32) {}
+
+SHIM_KMPC_LOOP(4, kmp_int32, kmp_int32)
+SHIM_KMPC_LOOP(4u, kmp_uint32, kmp_int32)
+SHIM_KMPC_LOOP(8, kmp_int64, kmp_int64)
+SHIM_KMPC_LOOP(8u, kmp_uint64, kmp_int64)
+
+#undef SHIM_KMPC_LOOP
+
+} // extern "C"
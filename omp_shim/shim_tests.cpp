@@ -0,0 +1,113 @@
+#include <atomic>
+#include <gtest/gtest.h>
+#include <omp.h>
+
+// Built with the project's compiler and OpenMP flags, so constructs go
+// through the same runtime entry points as in OMP_* benchmarks, and the shim
+// is linked before the runtime.
+
+namespace {
+long Fib(int n) {
+  if (n < 2) {
+    return n;
+  }
+  long a = 0;
+  long b = 0;
+#pragma omp task shared(a) if (n > 8)
+  a = Fib(n - 1);
+#pragma omp task shared(b) if (n > 8)
+  b = Fib(n - 2);
+#pragma omp taskwait
+  return a + b;
+}
+
+void Cancel() {
+#pragma omp parallel
+  {
+#pragma omp cancel parallel
+  }
+}
+} // namespace
+
+TEST(OmpShim, Tasks) {
+  long result = 0;
+#pragma omp parallel
+#pragma omp single
+  result = Fib(22);
+  EXPECT_EQ(17711, result);
+}
+
+TEST(OmpShim, Taskloop) {
+  std::atomic<long> sum{0};
+  long last = -1;
+#pragma omp parallel
+#pragma omp single
+  {
+#pragma omp taskloop grainsize(7)
+    for (long i = 0; i < 1000; ++i) {
+      sum += i;
+    }
+#pragma omp taskloop num_tasks(3) lastprivate(last)
+    for (long i = 0; i < 100; ++i) {
+      last = i;
+    }
+  }
+  EXPECT_EQ(499500, sum);
+  EXPECT_EQ(99, last);
+}
+
+TEST(OmpShim, TaskDependences) {
+  int x = 0;
+  int y = 0;
+#pragma omp parallel
+#pragma omp single
+  {
+#pragma omp task depend(out : x) shared(x)
+    x = 1;
+#pragma omp task depend(in : x) depend(out : y) shared(x, y)
+    y = x + 1;
+#pragma omp taskwait
+  }
+  EXPECT_EQ(2, y);
+}
+
+TEST(OmpShim, SynchronizationAndReductions) {
+  long critical = 0;
+  long double atomic = 0;
+  long reduced = 0;
+  long grouped = 0;
+  int threads = 0;
+#pragma omp parallel
+  {
+    for (int i = 0; i != 1000; ++i) {
+#pragma omp critical(named)
+      ++critical;
+#pragma omp atomic
+      atomic += 1;
+    }
+#pragma omp for reduction(+ : reduced)
+    for (int i = 0; i < 1000; ++i) {
+      reduced += i;
+    }
+#pragma omp taskgroup
+    {
+#pragma omp task
+      {
+#pragma omp atomic
+        ++grouped;
+      }
+    }
+#pragma omp single
+    threads = omp_get_num_threads();
+  }
+  EXPECT_EQ(1000 * threads, critical);
+  EXPECT_EQ(1000 * threads, atomic);
+  EXPECT_EQ(499500, reduced);
+  EXPECT_EQ(threads, grouped);
+}
+
+TEST(OmpShimDeathTest, UnsupportedAborts) {
+  // forked child wouldn't have workers of the pool
+  testing::FLAGS_gtest_death_test_style = "threadsafe";
+  EXPECT_DEATH(Cancel(), "isn't supported");
+}
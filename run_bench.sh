@@ -4,7 +4,10 @@ benchname=$1
 
 ompflags='OMP_MAX_ACTIVE_LEVELS=8 OMP_WAIT_POLICY=active KMP_BLOCKTIME=infinite KMP_AFFINITY="granularity=core,compact" LIBOMP_NUM_HIDDEN_HELPER_THREADS=0'
 prefix_path="cmake-build-release/benchmarks"
-cpu_speed=1995
+# TSC rate in MHz for LB4OMP, nominal frequency from the model name (TSC
+# runs at it on Intel) unless CPU_SPEED is given
+cpu_speed=${CPU_SPEED:-$(awk -F@ '/^model name/ && $2 ~ /GHz/ {printf "%d", $2 * 1000; exit}' /proc/cpuinfo)}
+cpu_speed=${cpu_speed:-1995}
 
 mkdir -p raw_results/$benchname
 
@@ -13,6 +16,22 @@ for x in $(ls -1 ${prefix_path}/bench_${benchname}_* | xargs -n 1 basename | gre
     sh -c "$ompflags $prefix_path/$x --benchmark_out_format=json --benchmark_out=raw_results/$benchname/$x.json";
 done
 
+# OMP_SHIM=1 additionally runs omp binaries with openmp runtime replaced by
+# EigenPool (see omp_shim), results are suffixed with _SHIM. OMP_TASKLOOP runs
+# on the shim's task queue, OMP_RUNTIME needs LB4OMP schedules it doesn't have
+omp_shim="cmake-build-release/omp_shim/libeigen_omp_shim.so"
+if [ -n "$OMP_SHIM" ]; then
+    if [ ! -f "$omp_shim" ]; then
+        echo "$omp_shim isn't built" >&2
+        exit 1
+    fi
+    for x in $(ls -1 ${prefix_path}/bench_${benchname}_* | xargs -n 1 basename | grep OMP_ | grep -v OMP_RUNTIME | sort); do
+        # the shim aborts on constructs it doesn't implement
+        sh -c "LD_PRELOAD=$omp_shim $prefix_path/$x --benchmark_out_format=json --benchmark_out=raw_results/$benchname/${x}_SHIM.json" ||
+            echo "$x failed with the shim" >&2;
+    done
+fi
+
 lb4ompmodes=("fsc" "fac" "fac2" "tap" "mfsc" "tfss" "fiss" "awf" "af")
 
 for x in $(ls -1 ${prefix_path}/bench_${benchname}_* | xargs -n 1 basename | grep OMP_RUNTIME); do
@@ -3,7 +3,10 @@ set -euxo pipefail
 
 ompflags='OMP_MAX_ACTIVE_LEVELS=8 OMP_WAIT_POLICY=active KMP_BLOCKTIME=infinite KMP_AFFINITY="granularity=core,compact" LIBOMP_NUM_HIDDEN_HELPER_THREADS=0'
 prefix_path="cmake-build-release/scheduling_dist"
-cpu_speed=1995
+# TSC rate in MHz for LB4OMP, nominal frequency from the model name (TSC
+# runs at it on Intel) unless CPU_SPEED is given
+cpu_speed=${CPU_SPEED:-$(awk -F@ '/^model name/ && $2 ~ /GHz/ {printf "%d", $2 * 1000; exit}' /proc/cpuinfo)}
+cpu_speed=${cpu_speed:-1995}
 
 mkdir -p raw_results/scheduling_dist
 
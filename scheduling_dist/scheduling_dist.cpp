@@ -1,19 +1,58 @@
 #include "../include/parallel_for.h"
 
-#include "../include/trace.h"
+#include "../include/chrome_trace.h"
+#include "../include/histogram.h"
+#include "../include/ring_trace.h"
 
 #include <atomic>
 #include <chrono>
 #include <cstdint>
+#include <cstdlib>
 #include <iostream>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
 #define SPIN 1
 #define BARRIER 2
 #define RUNNING 3
+#define SLOW_THREAD 4
 
-static void RunWithBarrier(size_t threadNum, Tracing::Tracer &tracer) {
+static constexpr size_t ITERATIONS = 10;
+
+// Instead of tracing every task streams start latency of tasks and iteration
+// time into histograms, so memory doesn't grow with the number of iterations.
+class LatencyRecorder {
+public:
+  explicit LatencyRecorder(size_t threadNum) : StartLatency_(threadNum) {}
+
+  template <typename F> void RunIteration(size_t tasks, F &&f) {
+    auto start = Now();
+    ParallelFor(0, tasks, [&](size_t i) {
+      StartLatency_.Record(GetThreadIndex(), Now() - start);
+      f(i);
+    });
+    IterationTime_.Record(Now() - start);
+  }
+
+  void PrintJson(size_t threadNum) const {
+    std::cout << "{\n"
+              << "\"thread_num\": " << threadNum << ",\n"
+              << "\"ticks_per_ns\": " << TicksPerNs() << ",\n"
+              << "\"start_latency\": ";
+    StartLatency_.Merged()->PrintQuantiles(std::cout);
+    std::cout << ",\n\"iteration_time\": ";
+    IterationTime_.PrintQuantiles(std::cout);
+    std::cout << "\n}\n";
+  }
+
+private:
+  HistogramSet StartLatency_;
+  Histogram IterationTime_; // written by the calling thread only
+};
+
+template <typename Tracer>
+static void RunWithBarrier(size_t threadNum, Tracer &tracer) {
   std::atomic<size_t> reported(0);
   tracer.RunIteration(threadNum, [&](size_t i) {
     reported.fetch_add(1, std::memory_order_relaxed);
@@ -25,7 +64,8 @@ static void RunWithBarrier(size_t threadNum, Tracing::Tracer &tracer) {
   });
 }
 
-static void RunWithSpin(size_t threadNum, Tracing::Tracer &tracer,
+template <typename Tracer>
+static void RunWithSpin(size_t threadNum, Tracer &tracer,
                         size_t tasksPerThread = 1) {
   uint64_t spinPerIter = 100'000'000 / tasksPerThread;
   auto tasksCount = threadNum * tasksPerThread;
@@ -37,7 +77,25 @@ static void RunWithSpin(size_t threadNum, Tracing::Tracer &tracer,
   });
 }
 
-static void RunOnce(size_t threadNum, Tracing::Tracer &tracer) {
+// thread 1 emulates a slower core (or one shared with other process): its
+// tasks take SLOWDOWN times longer, schedulers which learn thread speed
+// (EIGEN_AWF) should give it less iterations in later runs
+template <typename Tracer>
+static void RunWithSlowThread(size_t threadNum, Tracer &tracer,
+                              size_t tasksPerThread = 100) {
+  constexpr uint64_t SLOWDOWN = 4;
+  uint64_t spinPerIter = 100'000'000 / tasksPerThread;
+  auto tasksCount = threadNum * tasksPerThread;
+  tracer.RunIteration(tasksCount, [&](size_t i) {
+    auto spin = GetThreadIndex() == 1 ? spinPerIter * SLOWDOWN : spinPerIter;
+    for (size_t j = 0; j < spin; ++j) {
+      CpuRelax();
+    }
+  });
+}
+
+template <typename Tracer>
+static void RunOnce(size_t threadNum, Tracer &tracer) {
 #if defined(__x86_64__)
   asm volatile("mfence" ::: "memory");
 #elif defined(__aarch64__)
@@ -57,6 +115,8 @@ static void RunOnce(size_t threadNum, Tracing::Tracer &tracer) {
   return RunWithSpin(threadNum, tracer);
 #elif SCHEDULING_MEASURE_MODE == MULTITASK
   return RunWithSpin(threadNum, tracer, 100);
+#elif SCHEDULING_MEASURE_MODE == SLOW_THREAD
+  return RunWithSlowThread(threadNum, tracer);
 #else
   static_assert(false, "Unsupported mode");
 #endif
@@ -66,10 +126,24 @@ int main(int argc, char **argv) {
   auto threadNum = GetNumThreads();
   InitParallel(threadNum);
 
-  Tracing::Tracer tracer;
-  for (size_t i = 0; i < 10; ++i) {
+  // SCHED_DIST_ITERATIONS makes a long run which reports only quantiles
+  if (const char *iterations = std::getenv("SCHED_DIST_ITERATIONS")) {
+    LatencyRecorder recorder(threadNum);
+    for (size_t i = 0, n = std::stoul(iterations); i < n; ++i) {
+      RunOnce(threadNum, recorder);
+    }
+    recorder.PrintJson(threadNum);
+    return 0;
+  }
+
+  // enough for all records on one thread: two per task, at most 100 tasks
+  // per thread, and two per iteration
+  Tracing::RingTracer tracer(threadNum,
+                             ITERATIONS * 2 * (threadNum * 100 + 1));
+  for (size_t i = 0; i < ITERATIONS; ++i) {
     RunOnce(threadNum, tracer);
   }
   std::cout << tracer.ToJson(threadNum);
+  Tracing::WriteChromeTraceFromEnv(tracer);
   return 0;
 }
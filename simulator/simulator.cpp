@@ -0,0 +1,301 @@
+#include "../include/histogram.h"
+#include "../include/simulator.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// Predicts makespan and start latency of a ParallelFor from iteration costs,
+// without running it. Costs are synthetic or taken from a scheduling_dist
+// trace, then measured times of the trace are printed next to predicted ones.
+//
+//   scheduler_simulator --threads 8 --iterations 8 --cost exp:5000
+//   scheduler_simulator --cost trace:trace.json --balance simple --k-split 4
+//
+// All times are in Now() ticks.
+
+namespace {
+
+void Usage() {
+  std::cerr
+      << "usage: scheduler_simulator [options]\n"
+      << "  --threads N        virtual threads (4)\n"
+      << "  --iterations N     iterations of ParallelFor (threads)\n"
+      << "  --cost SPEC        const:X | uniform:A:B | exp:MEAN | trace:FILE\n"
+      << "  --push X --wake X --pop X --steal X --steal-fail X\n"
+      << "                     primitive costs, see Simulator::Costs\n"
+      << "  --balance MODE     off | simple | delayed (delayed)\n"
+      << "  --steal-policy P   random | neighbours (random)\n"
+      << "  --k-split N --init-time X --grain N\n"
+      << "  --runs N           simulated runs (100)\n"
+      << "  --seed N\n";
+  std::exit(1);
+}
+
+std::vector<std::string> SplitBy(const std::string &str, char delim) {
+  std::vector<std::string> parts;
+  size_t from = 0;
+  while (true) {
+    auto to = str.find(delim, from);
+    parts.push_back(str.substr(from, to - from));
+    if (to == std::string::npos) {
+      return parts;
+    }
+    from = to + 1;
+  }
+}
+
+// what's needed from a trace of scheduling_dist (Tracing::ToJson)
+struct Trace {
+  size_t Threads = 0;
+  double TicksPerNs = 0;
+  std::vector<double> Costs; // median of each task's execution time
+  Histogram Makespan;
+  Histogram StartLatency; // first task of each thread
+};
+
+// finds `"key": value` from pos, returns value and moves pos after it
+bool NextNumber(const std::string &text, const std::string &key, size_t &pos,
+                double &value) {
+  auto found = text.find("\"" + key + "\":", pos);
+  if (found == std::string::npos) {
+    return false;
+  }
+  pos = found + key.size() + 3;
+  value = std::strtod(text.c_str() + pos, nullptr);
+  return true;
+}
+
+// Number of the key before limit, from pos, the file is small enough to
+// scan it instead of parsing.
+bool NumberBefore(const std::string &text, const std::string &key,
+                  size_t &pos, size_t limit, double &value) {
+  auto saved = pos;
+  if (!NextNumber(text, key, pos, value) || pos > limit) {
+    pos = saved;
+    return false;
+  }
+  return true;
+}
+
+void ReadTrace(const std::string &file, Trace &trace) {
+  std::ifstream in(file);
+  if (!in) {
+    std::cerr << "can't open " << file << "\n";
+    std::exit(1);
+  }
+  std::string text((std::istreambuf_iterator<char>(in)),
+                   std::istreambuf_iterator<char>());
+  size_t pos = 0;
+  double value = 0;
+  if (!NextNumber(text, "thread_num", pos, value)) {
+    std::cerr << file << " isn't a scheduling_dist trace\n";
+    std::exit(1);
+  }
+  trace.Threads = value;
+  NextNumber(text, "tasks_num", pos, value);
+  std::vector<std::vector<double>> durations(value);
+  if (NextNumber(text, "ticks_per_ns", pos, value)) {
+    trace.TicksPerNs = value;
+  }
+  // times in an iteration are from its start
+  double start = 0;
+  while (NextNumber(text, "start", pos, start)) {
+    double end = 0;
+    NextNumber(text, "end", pos, end);
+    trace.Makespan.Record(end);
+    auto next = text.find("\"start\":", pos);
+    // tasks of a thread are a list: "thread": [{..}, ..]
+    for (auto open = text.find('[', pos); open < next;
+         open = text.find('[', pos)) {
+      auto close = text.find(']', open);
+      pos = open;
+      double index = 0;
+      double firstStart = -1;
+      while (NumberBefore(text, "index", pos, close, index)) {
+        double first = 0;
+        double last = 0;
+        NextNumber(text, "execution_start", pos, first);
+        NextNumber(text, "execution_end", pos, last);
+        if (index < durations.size()) {
+          durations[index].push_back(last - first);
+        }
+        if (firstStart < 0 || first < firstStart) {
+          firstStart = first;
+        }
+      }
+      if (firstStart >= 0) {
+        trace.StartLatency.Record(firstStart);
+      }
+      pos = close;
+    }
+  }
+  for (auto &taskDurations : durations) {
+    if (taskDurations.empty()) {
+      trace.Costs.push_back(0);
+      continue;
+    }
+    auto mid = taskDurations.begin() + taskDurations.size() / 2;
+    std::nth_element(taskDurations.begin(), mid, taskDurations.end());
+    trace.Costs.push_back(*mid);
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Simulator::Config config;
+  size_t iterations = 0;
+  size_t runs = 100;
+  uint64_t seed = 0;
+  std::string cost = "const:1000";
+  auto number = [&](int &i) {
+    if (++i == argc) {
+      Usage();
+    }
+    return std::stod(argv[i]);
+  };
+  auto word = [&](int &i) -> std::string {
+    if (++i == argc) {
+      Usage();
+    }
+    return argv[i];
+  };
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--threads") {
+      config.Threads = number(i);
+    } else if (arg == "--iterations") {
+      iterations = number(i);
+    } else if (arg == "--cost") {
+      cost = word(i);
+    } else if (arg == "--push") {
+      config.Cost.Push = number(i);
+    } else if (arg == "--wake") {
+      config.Cost.Wake = number(i);
+    } else if (arg == "--pop") {
+      config.Cost.Pop = number(i);
+    } else if (arg == "--steal") {
+      config.Cost.Steal = number(i);
+    } else if (arg == "--steal-fail") {
+      config.Cost.StealFail = number(i);
+    } else if (arg == "--k-split") {
+      config.KSplit = number(i);
+    } else if (arg == "--init-time") {
+      config.InitTime = number(i);
+    } else if (arg == "--grain") {
+      config.GrainSize = number(i);
+    } else if (arg == "--runs") {
+      runs = number(i);
+    } else if (arg == "--seed") {
+      seed = number(i);
+    } else if (arg == "--balance") {
+      auto mode = word(i);
+      if (mode == "off") {
+        config.Mode = Simulator::Balance::OFF;
+      } else if (mode == "simple") {
+        config.Mode = Simulator::Balance::SIMPLE;
+      } else if (mode == "delayed") {
+        config.Mode = Simulator::Balance::DELAYED;
+      } else {
+        Usage();
+      }
+    } else if (arg == "--steal-policy") {
+      auto policy = word(i);
+      if (policy == "random") {
+        config.Steal = Simulator::StealPolicy::RANDOM;
+      } else if (policy == "neighbours") {
+        config.Steal = Simulator::StealPolicy::NEIGHBOURS;
+      } else {
+        Usage();
+      }
+    } else {
+      Usage();
+    }
+  }
+  if (config.Threads == 0 || config.KSplit == 0 || runs == 0) {
+    Usage();
+  }
+
+  auto spec = SplitBy(cost, ':');
+  std::unique_ptr<Trace> trace;
+  if (spec[0] == "trace" && spec.size() == 2) {
+    trace = std::make_unique<Trace>();
+    ReadTrace(spec[1], *trace);
+    config.Threads = trace->Threads;
+    iterations = trace->Costs.size();
+  } else if (!(spec[0] == "const" && spec.size() == 2) &&
+             !(spec[0] == "uniform" && spec.size() == 3) &&
+             !(spec[0] == "exp" && spec.size() == 2)) {
+    Usage();
+  }
+  if (iterations == 0) {
+    iterations = config.Threads;
+  }
+
+  std::mt19937_64 random(seed);
+  auto generate = [&](std::vector<double> &costs) {
+    if (trace) {
+      costs = trace->Costs;
+      return;
+    }
+    costs.resize(iterations);
+    for (auto &c : costs) {
+      if (spec[0] == "const") {
+        c = std::stod(spec[1]);
+      } else if (spec[0] == "uniform") {
+        c = std::uniform_real_distribution<double>(std::stod(spec[1]),
+                                                   std::stod(spec[2]))(random);
+      } else {
+        c = std::exponential_distribution<double>(1 / std::stod(spec[1]))(
+            random);
+      }
+    }
+  };
+
+  Histogram makespan;
+  Histogram startLatency;
+  Histogram spawned;
+  Histogram steals;
+  std::vector<double> costs;
+  for (size_t run = 0; run != runs; ++run) {
+    generate(costs);
+    auto result = Simulator::Simulation(config, costs, random()).Run();
+    makespan.Record(result.Makespan);
+    for (auto latency : result.StartLatency) {
+      if (latency >= 0) {
+        startLatency.Record(latency);
+      }
+    }
+    spawned.Record(result.Spawned);
+    steals.Record(result.Steals);
+  }
+
+  std::cout << "{\n\"threads\": " << config.Threads
+            << ",\n\"iterations\": " << iterations << ",\n\"runs\": " << runs
+            << ",\n\"predicted\": {\n  \"makespan\": ";
+  makespan.PrintQuantiles(std::cout);
+  std::cout << ",\n  \"start_latency\": ";
+  startLatency.PrintQuantiles(std::cout);
+  std::cout << ",\n  \"spawned\": ";
+  spawned.PrintQuantiles(std::cout);
+  std::cout << ",\n  \"steals\": ";
+  steals.PrintQuantiles(std::cout);
+  std::cout << "\n}";
+  if (trace) {
+    std::cout << ",\n\"ticks_per_ns\": " << trace->TicksPerNs
+              << ",\n\"measured\": {\n  \"makespan\": ";
+    trace->Makespan.PrintQuantiles(std::cout);
+    std::cout << ",\n  \"start_latency\": ";
+    trace->StartLatency.PrintQuantiles(std::cout);
+    std::cout << "\n}";
+  }
+  std::cout << "\n}\n";
+}
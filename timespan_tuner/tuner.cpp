@@ -1,5 +1,9 @@
+#include "../include/histogram.h"
 #include "../include/parallel_for.h"
+#include <cstdlib>
 #include <ctime>
+#include <string>
+#include <utility>
 #include <vector>
 
 static void RunOnce(size_t threadNum, std::vector<Timestamp> *times) {
@@ -31,61 +35,53 @@ static void RunOnce(size_t threadNum, std::vector<Timestamp> *times) {
   });
 }
 
-static size_t PercentileIndex(double pc, size_t size) {
-  return 0.5 + static_cast<double>(size - 1) * pc;
-}
-
 int main() {
   auto threadNum = GetNumThreads();
   InitParallel(threadNum);
-  constexpr size_t ITERATIONS = 10000;
+  // long runs catch rare tail events, memory doesn't grow with iterations
+  size_t iterations = 10000;
+  if (const char *envIterations = std::getenv("TUNER_ITERATIONS")) {
+    iterations = std::stoul(envIterations);
+  }
 
   for (size_t i = 0; i != 10; ++i) {
     RunOnce(threadNum, nullptr); // warmup
   }
 
-  std::vector<std::vector<Timestamp>> results(
-      ITERATIONS, std::vector<Timestamp>(threadNum));
-  for (size_t i = 0; i != ITERATIONS; ++i) {
-    RunOnce(threadNum, &results[i]);
-  }
-  std::vector<Timestamp> flat_results;
-  std::vector<Timestamp> maximums;
+  std::vector<Timestamp> times(threadNum);
+  Histogram total;
+  Histogram maximums;
   double sum = 0;
   double sum_max = 0;
-  for (auto &&r : results) {
-    auto max = r.front();
-    for (auto &&v : r) {
-      flat_results.push_back(v);
+  for (size_t i = 0; i != iterations; ++i) {
+    RunOnce(threadNum, &times);
+    auto max = times.front();
+    for (auto &&v : times) {
+      total.Record(v);
       sum += v;
       max = std::max(max, v);
     }
-    maximums.push_back(max);
+    maximums.Record(max);
     sum_max += max;
   }
-  std::sort(maximums.begin(), maximums.end());
-  std::sort(flat_results.begin(), flat_results.end());
   std::cout
       << "==================================================================\n";
   std::cout << "Mode: " + GetParallelMode() + ", threads: " << threadNum
-            << ", iterations: " << ITERATIONS << "\n";
-  std::cout << "Average: " << sum / flat_results.size() << " (total), "
-            << sum_max / maximums.size() << " (maximums) \n";
-  std::cout << "Minimum: " << flat_results.front() << " (maximums) \n";
-  std::cout << "Median: "
-            << flat_results.at(PercentileIndex(0.5, flat_results.size()))
-            << " (total), "
-            << maximums.at(PercentileIndex(0.5, maximums.size()))
-            << " (maximums) \n";
-  std::cout << "0.95 percentile: "
-            << flat_results.at(PercentileIndex(0.95, flat_results.size()))
-            << " (total), "
-            << maximums.at(PercentileIndex(0.95, maximums.size()))
-            << " (maximums) \n";
-  std::cout << "0.99 percentile: "
-            << flat_results.at(PercentileIndex(0.99, flat_results.size()))
-            << " (total), "
-            << maximums.at(PercentileIndex(0.99, maximums.size()))
-            << " (maximums) \n";
-  std::cout << "Maximum: " << flat_results.back() << " (maximums) \n";
+            << ", iterations: " << iterations << "\n";
+  std::cout << "Average: " << sum / total.Count() << " (total), "
+            << sum_max / maximums.Count() << " (maximums) \n";
+  std::cout << "Minimum: " << total.Min() << " (maximums) \n";
+  for (auto [name, q] : {std::pair{"Median", 0.5}, {"0.95 percentile", 0.95},
+                         {"0.99 percentile", 0.99},
+                         {"0.999 percentile", 0.999}}) {
+    std::cout << name << ": " << total.Quantile(q) << " (total), "
+              << maximums.Quantile(q) << " (maximums) \n";
+  }
+  std::cout << "Maximum: " << total.Max() << " (maximums) \n";
+  // the same INIT_TIME may be used on machines with other clock rates
+  std::cout << "Clock: " << TicksPerNs() << " ticks per ns"
+            << (IsClockInvariant() ? "" : " (not invariant)") << "\n";
+  std::cout << "INIT_TIME_NS="
+            << static_cast<uint64_t>(CyclesToNs(maximums.Quantile(0.99)))
+            << "\n";
 }
@@ -1,6 +1,7 @@
-
 #include "../include/parallel_for.h"
 
+#include "../include/chrome_trace.h"
+#include "../include/ring_trace.h"
 #include "../include/trace.h"
 
 #include <atomic>
@@ -10,23 +11,44 @@
 #include <unordered_map>
 #include <vector>
 
-static void RunSpin(size_t threadNum, Tracing::Tracer &tracer) {
-  tracer.RunIteration(threadNum, [&](size_t i) {
-    // emulating small work
-    for (size_t i = 0; i < 1; ++i) {
-      CpuRelax();
-    }
-  });
+static constexpr size_t ITERATIONS = 1024;
+
+static void SmallWork() {
+  // emulating small work
+  for (size_t i = 0; i < 1; ++i) {
+    CpuRelax();
+  }
+}
+
+// mean iteration time of ITERATIONS runs
+template <typename F> static Timestamp MeasureIteration(F &&runIteration) {
+  auto start = Now();
+  for (size_t i = 0; i < ITERATIONS; ++i) {
+    runIteration();
+  }
+  return (Now() - start) / ITERATIONS;
 }
 
 int main(int argc, char **argv) {
   auto threadNum = GetNumThreads();
   InitParallel(threadNum);
 
+  // probe effect: the same loop without tracing, with Tracer and with
+  // RingTracer, the last one is printed
+  auto plain = MeasureIteration(
+      [&] { ParallelFor(0, threadNum, [&](size_t) { SmallWork(); }); });
   Tracing::Tracer tracer;
-  for (size_t i = 0; i < 1024; ++i) {
-    RunSpin(threadNum, tracer);
-  }
-  std::cout << tracer.ToJson(threadNum);
+  auto traced = MeasureIteration(
+      [&] { tracer.RunIteration(threadNum, [&](size_t) { SmallWork(); }); });
+  Tracing::RingTracer ringTracer(threadNum, 2 * ITERATIONS * (threadNum + 1));
+  auto ringTraced = MeasureIteration([&] {
+    ringTracer.RunIteration(threadNum, [&](size_t) { SmallWork(); });
+  });
+  std::cerr << "iteration time, no trace: " << plain
+            << ", Tracer: " << traced << ", RingTracer: " << ringTraced
+            << "\n";
+
+  std::cout << ringTracer.ToJson(threadNum);
+  Tracing::WriteChromeTraceFromEnv(ringTracer);
   return 0;
 }